@@ -0,0 +1,729 @@
+/*
+ * bench.c
+ * OS Chat System - transport benchmark
+ * Drives the shared-memory transport from one producer process and one or
+ * more consumer processes, without a TTY, and reports throughput, one-way
+ * latency percentiles and syscalls per message for each transport variant.
+ */
+
+#include "chat_common.h"
+#include "chat_histogram.h"
+#include "chat_wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define BENCH_DEFAULT_COUNT 100000
+#define BENCH_MAX_SIZES     16
+#define BENCH_MAX_READERS   (MAX_USERS - 1)
+#define LEGACY_SLOTS        10
+#define GATEWAY_COUNT       2000  // Default --count for --gateway: each one goes to every subscriber
+
+struct bench_config {
+    const char* transport;  // "ring", "sem" or "all"
+    uint64_t count;
+    size_t sizes[BENCH_MAX_SIZES];
+    int size_count;
+    int readers;
+    const char* gateway;  // chatd socket for the fan-out benchmark
+    int subscribers;
+};
+
+// Filled in by each child process; lives in a MAP_SHARED anonymous mapping
+struct bench_result {
+    struct chat_histogram latency;
+    uint64_t received;
+    uint64_t syscalls;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// The original protocol: a fixed array of fixed-size messages with every
+// send and every receive taken under semaphore 0
+struct legacy_message {
+    char content[MAX_MESSAGE_LEN];
+    char sender[MAX_USERNAME_LEN];
+    int type;
+    int message_id;
+};
+
+struct legacy_seg {
+    struct legacy_message messages[LEGACY_SLOTS];
+    int message_count;
+    int last_message_id;
+};
+
+static size_t payload_size(const struct bench_config* cfg, uint64_t i, size_t limit) {
+    size_t size = cfg->sizes[i % (uint64_t)cfg->size_count];
+    if (size < sizeof(uint64_t)) {
+        size = sizeof(uint64_t);  // Room for the send timestamp
+    }
+    return size > limit ? limit : size;
+}
+
+static int private_semaphore(void) {
+    union semun {
+        int val;
+        struct semid_ds *buf;
+        unsigned short *array;
+    } arg;
+    int semid = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+    if (semid == -1) {
+        perror("semget failed");
+        exit(1);
+    }
+    arg.val = 1;
+    semctl(semid, 0, SETVAL, arg);
+    return semid;
+}
+
+/* ---- Lock-free room transport ---- */
+
+static void ring_producer(struct shmseg* shm, const struct bench_config* cfg, struct bench_result* out) {
+    char* payload = calloc(1, CHAT_MAX_PAYLOAD);
+    memset(payload + sizeof(uint64_t), 'x', CHAT_MAX_PAYLOAD - sizeof(uint64_t));
+
+    out->start_ns = chat_now_ns();
+    for (uint64_t i = 0; i < cfg->count; i++) {
+        size_t size = payload_size(cfg, i, CHAT_MAX_PAYLOAD);
+        while (1) {
+            uint32_t tail = atomic_load(&shm->tail);
+            uint64_t sent = chat_now_ns();
+            memcpy(payload, &sent, sizeof(sent));
+            if (room_publish(shm, NULL, payload, size, MSG_TYPE_NORMAL)) {
+                break;
+            }
+            room_wait_writable(shm, tail, NULL);
+        }
+    }
+    out->end_ns = chat_now_ns();
+    out->syscalls = atomic_load(&chat_syscalls);
+    free(payload);
+}
+
+static void ring_consumer(struct shmseg* shm, int index, const struct bench_config* cfg,
+                          struct bench_result* out) {
+    struct chat_participant* me = &shm->participants[index];
+    struct chat_message msg;
+
+    hist_init(&out->latency);
+    while (out->received < cfg->count) {
+        uint32_t seen = atomic_load(&shm->published);
+        if (!room_read(shm, me, &msg)) {
+            room_wait_published(shm, seen, NULL);
+            continue;
+        }
+        uint64_t sent;
+        memcpy(&sent, msg.content, sizeof(sent));
+        hist_record(&out->latency, chat_now_ns() - sent);
+        out->received++;
+        room_advance(shm, me);
+    }
+    out->end_ns = chat_now_ns();
+    out->syscalls = atomic_load(&chat_syscalls);
+}
+
+/* ---- Legacy semaphore transport ---- */
+
+static void legacy_producer(struct legacy_seg* seg, int semid, const struct bench_config* cfg,
+                            struct bench_result* out) {
+    out->start_ns = chat_now_ns();
+    for (uint64_t i = 0; i < cfg->count; ) {
+        size_t size = payload_size(cfg, i, MAX_MESSAGE_LEN - 1);
+        sem_wait(semid, 0);
+        if (seg->message_count < LEGACY_SLOTS) {
+            struct legacy_message* m = &seg->messages[seg->message_count];
+            uint64_t sent = chat_now_ns();
+            memset(m->content, 'x', size);
+            memcpy(m->content, &sent, sizeof(sent));
+            m->content[size] = '\0';
+            strncpy(m->sender, "bench", MAX_USERNAME_LEN - 1);
+            m->type = MSG_TYPE_NORMAL;
+            m->message_id = ++seg->last_message_id;
+            seg->message_count++;
+            i++;
+        }
+        int full = seg->message_count >= LEGACY_SLOTS;
+        sem_signal(semid, 0);
+        if (full) {
+            sched_yield();
+        }
+    }
+    out->end_ns = chat_now_ns();
+    out->syscalls = atomic_load(&chat_syscalls);
+}
+
+static void legacy_consumer(struct legacy_seg* seg, int semid, const struct bench_config* cfg,
+                            struct bench_result* out) {
+    hist_init(&out->latency);
+    while (out->received < cfg->count) {
+        sem_wait(semid, 0);
+        int count = seg->message_count;
+        for (int i = 0; i < count; i++) {
+            uint64_t sent;
+            memcpy(&sent, seg->messages[i].content, sizeof(sent));
+            hist_record(&out->latency, chat_now_ns() - sent);
+        }
+        seg->message_count = 0;  // Everything seen is processed
+        sem_signal(semid, 0);
+        out->received += (uint64_t)count;
+        if (count == 0) {
+            sched_yield();
+        }
+    }
+    out->end_ns = chat_now_ns();
+    out->syscalls = atomic_load(&chat_syscalls);
+}
+
+/* ---- chatd gateway fan-out ---- */
+
+static void print_sizes(const struct bench_config* cfg, char* out, size_t len);
+
+struct gateway_sub {
+    int fd;
+    int joined;  // WELCOME seen
+    char* buf;
+    size_t len, cap;
+    uint64_t received;
+};
+
+static int gateway_connect(const char* path, int i) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    char frame[WIRE_HEADER_SIZE + MAX_USERNAME_LEN];
+
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("cannot connect to chatd");
+        exit(1);
+    }
+    int n = snprintf(frame + WIRE_HEADER_SIZE, MAX_USERNAME_LEN, "sub%d", i);
+    wire_header(frame, WIRE_HELLO, (size_t)n);
+    if (write(fd, frame, WIRE_HEADER_SIZE + (size_t)n) != WIRE_HEADER_SIZE + n) {
+        perror("HELLO failed");
+        exit(1);
+    }
+    return fd;
+}
+
+// Read what is available and handle every complete frame. Returns 0 once
+// the gateway hangs up.
+static int gateway_read(struct gateway_sub* sub, struct chat_histogram* latency) {
+    if (sub->cap - sub->len < 16 * 1024) {
+        sub->cap = sub->cap ? sub->cap * 2 : 64 * 1024;
+        sub->buf = realloc(sub->buf, sub->cap);
+        if (!sub->buf) {
+            perror("realloc failed");
+            exit(1);
+        }
+    }
+    ssize_t n = read(sub->fd, sub->buf + sub->len, sub->cap - sub->len);
+    if (n <= 0) {
+        return n == -1 && (errno == EAGAIN || errno == EINTR);
+    }
+    sub->len += (size_t)n;
+
+    size_t pos = 0;
+    int type;
+    const char* payload;
+    size_t length;
+    long size;
+    uint64_t now = chat_now_ns();
+    while ((size = wire_frame(sub->buf + pos, sub->len - pos, &type, &payload, &length)) > 0) {
+        if (type == WIRE_WELCOME) {
+            sub->joined = 1;
+        } else if (type == WIRE_ERROR) {
+            fprintf(stderr, "chatd: %.*s\n", (int)length, payload);
+            return 0;
+        } else if (type == WIRE_MESSAGE && payload[8] == MSG_TYPE_NORMAL) {
+            size_t sender_len = (unsigned char)payload[9];
+            const char* text = payload + WIRE_MESSAGE_FIXED + sender_len;
+            uint64_t sent;
+            if (length >= WIRE_MESSAGE_FIXED + sender_len + sizeof(sent) && sender_len == 5 &&
+                memcmp(payload + WIRE_MESSAGE_FIXED, "bench", 5) == 0) {
+                memcpy(&sent, text, sizeof(sent));
+                hist_record(latency, now - sent);
+                sub->received++;
+            }
+        }
+        pos += (size_t)size;
+    }
+    if (size < 0) {
+        fprintf(stderr, "bad frame from chatd\n");
+        return 0;
+    }
+    memmove(sub->buf, sub->buf + pos, sub->len - pos);
+    sub->len -= pos;
+    return 1;
+}
+
+// Publish cfg->count timestamped messages into the room as "bench"
+static void gateway_publisher(const struct bench_config* cfg) {
+    ChatSession session;
+    char* payload = calloc(1, CHAT_MAX_PAYLOAD);
+
+    if (!payload || !chat_open(&session, "bench")) {
+        _exit(1);
+    }
+    memset(payload + sizeof(uint64_t), 'x', CHAT_MAX_PAYLOAD - sizeof(uint64_t));
+    for (uint64_t i = 0; i < cfg->count; i++) {
+        while (1) {
+            uint64_t sent = chat_now_ns();
+            memcpy(payload, &sent, sizeof(sent));
+            if (chat_send(&session, payload, payload_size(cfg, i, CHAT_MAX_PAYLOAD), MSG_TYPE_NORMAL, 10)) {
+                break;
+            }
+            // Subscribers joining and leaving are messages too; left unread
+            // they would pin the ring
+            struct chat_message msg;
+            while (chat_recv(&session, &msg, 0)) {
+            }
+        }
+    }
+    chat_close(&session);
+    free(payload);
+}
+
+// Subscribe N clients to a running chatd from this process, publish into
+// the room from a child, and time delivery of every message to every
+// subscriber through the gateway
+static void run_gateway(const struct bench_config* cfg) {
+    int n = cfg->subscribers;
+    struct gateway_sub* subs = calloc((size_t)n, sizeof(*subs));
+    struct chat_histogram* latency = malloc(sizeof(*latency));
+    struct epoll_event ev, events[256];
+    char sizes[128];
+
+    if (!subs || !latency) {
+        perror("malloc failed");
+        exit(1);
+    }
+    hist_init(latency);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < n; i++) {
+        subs[i].fd = gateway_connect(cfg->gateway, i);
+    }
+    // Everyone must be subscribed before the first message goes out
+    for (int i = 0; i < n; i++) {
+        while (!subs[i].joined) {
+            if (!gateway_read(&subs[i], latency)) {
+                exit(1);
+            }
+        }
+        fcntl(subs[i].fd, F_SETFL, O_NONBLOCK);
+        ev = (struct epoll_event){.events = EPOLLIN, .data.u32 = (uint32_t)i};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, subs[i].fd, &ev);
+    }
+
+    uint64_t start = chat_now_ns();
+    pid_t publisher = fork();
+    if (publisher == 0) {
+        gateway_publisher(cfg);
+        chat_trace_flush();
+        _exit(0);
+    }
+    uint64_t want = cfg->count * (uint64_t)n, total = 0;
+    int dropped = 0;
+    while (total < want) {
+        int ready = epoll_wait(epfd, events, 256, 10000);
+        if (ready <= 0) {
+            fprintf(stderr, "stalled after %llu of %llu deliveries\n", (unsigned long long)total,
+                    (unsigned long long)want);
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            struct gateway_sub* sub = &subs[events[i].data.u32];
+            uint64_t before = sub->received;
+            int open = gateway_read(sub, latency);
+            total += sub->received - before;
+            if (!open) {
+                // Dropped as too slow: stop waiting for its share
+                epoll_ctl(epfd, EPOLL_CTL_DEL, sub->fd, NULL);
+                want -= cfg->count - sub->received;
+                dropped++;
+            }
+        }
+    }
+    double seconds = (double)(chat_now_ns() - start) / 1e9;
+    waitpid(publisher, NULL, 0);
+
+    print_sizes(cfg, sizes, sizeof(sizes));
+    printf("%-7s %11s %14s %10s %14s %9s %9s %9s %9s\n", "mode", "subscribers", "sizes", "messages",
+           "deliveries/sec", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    printf("%-7s %11d %14s %10llu %14.0f %9.1f %9.1f %9.1f %9.1f\n", "gateway", n, sizes,
+           (unsigned long long)cfg->count, (double)total / seconds,
+           hist_percentile(latency, 50.0) / 1000.0, hist_percentile(latency, 99.0) / 1000.0,
+           hist_percentile(latency, 99.9) / 1000.0, latency->max / 1000.0);
+    if (dropped > 0) {
+        printf("%d subscriber(s) fell too far behind and were dropped by chatd\n", dropped);
+    }
+
+    for (int i = 0; i < n; i++) {
+        close(subs[i].fd);
+        free(subs[i].buf);
+    }
+    close(epfd);
+    free(latency);
+    free(subs);
+}
+
+/* ---- Text microbenchmark ---- */
+
+#define TEXT_CORPUS_SIZE (64 * 1024 * 1024)
+#define TEXT_ROUNDS      8
+#define TEXT_LINES       (1 << 20)
+
+// The helpers before chat_text.h, kept for comparison
+static int legacy_is_exit(const char* message) {
+    char lower[MAX_MESSAGE_LEN];
+    if (strlen(message) >= MAX_MESSAGE_LEN) {
+        return 0;
+    }
+    strncpy(lower, message, MAX_MESSAGE_LEN);
+    for (int i = 0; lower[i]; i++) {
+        lower[i] = tolower(lower[i]);
+    }
+    return (strcmp(lower, "exit") == 0 || strcmp(lower, "bye") == 0 ||
+            strcmp(lower, "quit") == 0 || strcmp(lower, "q") == 0);
+}
+
+static void legacy_sanitize(char* input) {
+    for (int i = 0; input[i]; i++) {
+        if (input[i] < 32 && input[i] != '\n' && input[i] != '\t') {
+            input[i] = ' ';
+        }
+    }
+}
+
+// Chat-like text: plain ASCII, or with accented letters, CJK and emoji
+// mixed in. dirty adds a control byte every 64 bytes or so.
+static void fill_corpus(char* buf, size_t len, int utf8, int dirty) {
+    static const char* ascii_words[] = {"hello ", "the ", "build ", "passed ", "see ", "you ", "at ",
+                                        "noon, ", "ok? ", "thanks! "};
+    static const char* utf8_words[] = {"héllo ", "the ", "naïve ", "café ", "日本語 ", "ok ", "😀 ",
+                                       "wörld ", "see ", "🚀! "};
+    const char** words = utf8 ? utf8_words : ascii_words;
+    size_t used = 0;
+    uint32_t seed = 12345;
+
+    while (used < len) {
+        seed = seed * 1103515245u + 12345u;
+        const char* w = words[(seed >> 16) % 10];
+        size_t n = strlen(w);
+        if (used + n > len) {
+            memset(buf + used, ' ', len - used);
+            break;
+        }
+        memcpy(buf + used, w, n);
+        used += n;
+        if (dirty && (seed >> 8) % 10 == 0) {
+            buf[used - 1] = '\033';
+        }
+    }
+}
+
+static double gbps(size_t bytes, uint64_t ns) {
+    return (double)bytes / (double)ns;
+}
+
+static void text_row(const char* corpus, const char* op, size_t bytes, uint64_t ns) {
+    printf("%-6s %-22s %10zu %10.2f\n", corpus, op, bytes / (1024 * 1024), gbps(bytes, ns));
+}
+
+static void run_text(void) {
+    char* buf = malloc(TEXT_CORPUS_SIZE + 1);
+    char* work = malloc(TEXT_CORPUS_SIZE + 1);
+    if (!buf || !work) {
+        perror("malloc failed");
+        exit(1);
+    }
+    static const struct {
+        const char* name;
+        int utf8;
+        int dirty;
+    } corpora[] = {{"ascii", 0, 0}, {"utf8", 1, 0}, {"dirty", 1, 1}};
+    size_t total = (size_t)TEXT_CORPUS_SIZE * TEXT_ROUNDS;
+    volatile size_t sink = 0;
+
+    printf("%-6s %-22s %10s %10s\n", "corpus", "operation", "MB", "GB/s");
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        fill_corpus(buf, TEXT_CORPUS_SIZE, corpora[c].utf8, corpora[c].dirty);
+        buf[TEXT_CORPUS_SIZE] = '\0';
+
+        // Validation stops at the first problem, so it is only timed on clean text
+        if (!corpora[c].dirty) {
+            uint64_t start = chat_now_ns();
+            for (int r = 0; r < TEXT_ROUNDS; r++) {
+                sink += text_clean_prefix(buf, TEXT_CORPUS_SIZE);
+            }
+            text_row(corpora[c].name, "validate", total, chat_now_ns() - start);
+            start = chat_now_ns();
+            for (int r = 0; r < TEXT_ROUNDS; r++) {
+                sink += text_clean_prefix_scalar(buf, TEXT_CORPUS_SIZE);
+            }
+            text_row(corpora[c].name, "validate (sse2+scalar)", total, chat_now_ns() - start);
+        }
+
+        // Sanitizing repairs its input, so each round works on a fresh copy
+        // and only the pass itself is timed
+        uint64_t spent = 0, legacy_spent = 0, start;
+        for (int r = 0; r < TEXT_ROUNDS; r++) {
+            memcpy(work, buf, TEXT_CORPUS_SIZE + 1);
+            start = chat_now_ns();
+            sink += text_sanitize(work, TEXT_CORPUS_SIZE);
+            spent += chat_now_ns() - start;
+
+            memcpy(work, buf, TEXT_CORPUS_SIZE + 1);
+            start = chat_now_ns();
+            legacy_sanitize(work);
+            legacy_spent += chat_now_ns() - start;
+        }
+        text_row(corpora[c].name, "sanitize (utf-8 aware)", total, spent);
+        text_row(corpora[c].name, "sanitize (legacy)", total, legacy_spent);
+    }
+
+    // Command detection on chat-length lines, a few of them exit commands
+    static const char* lines[] = {"see you at noon", "Quit", "thanks for the review!", "q",
+                                  "ok", "EXIT", "the build passed on the second try", "bye!"};
+    size_t nlines = sizeof(lines) / sizeof(lines[0]);
+    uint64_t start = chat_now_ns();
+    for (int i = 0; i < TEXT_LINES; i++) {
+        sink += (size_t)is_exit_command(lines[i % nlines]);
+    }
+    uint64_t fast = chat_now_ns() - start;
+    start = chat_now_ns();
+    for (int i = 0; i < TEXT_LINES; i++) {
+        sink += (size_t)legacy_is_exit(lines[i % nlines]);
+    }
+    uint64_t slow = chat_now_ns() - start;
+    printf("\n%-29s %6.1f ns/line\n%-29s %6.1f ns/line\n",
+           "exit check (perfect hash)", (double)fast / TEXT_LINES,
+           "exit check (legacy)", (double)slow / TEXT_LINES);
+
+    (void)sink;
+    free(work);
+    free(buf);
+}
+
+/* ---- Driver ---- */
+
+static void print_sizes(const struct bench_config* cfg, char* out, size_t len) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (int i = 0; i < cfg->size_count && used < len; i++) {
+        used += (size_t)snprintf(out + used, len - used, "%s%zu", i ? "," : "", cfg->sizes[i]);
+    }
+}
+
+static void report(const char* transport, const struct bench_config* cfg, int readers,
+                   struct bench_result* results) {
+    struct chat_histogram all;
+    uint64_t syscalls = 0, end = 0;
+    char sizes[128];
+
+    hist_init(&all);
+    for (int i = 0; i <= readers; i++) {
+        syscalls += results[i].syscalls;
+        if (results[i].end_ns > end) {
+            end = results[i].end_ns;
+        }
+        if (i > 0) {
+            hist_merge(&all, &results[i].latency);
+        }
+    }
+    double seconds = (double)(end - results[0].start_ns) / 1e9;
+    print_sizes(cfg, sizes, sizeof(sizes));
+
+    printf("%-6s %7d %14s %10llu %12.0f %9.1f %9.1f %9.1f %9.1f %12.3f\n",
+           transport, readers, sizes, (unsigned long long)cfg->count,
+           (double)cfg->count / seconds,
+           hist_percentile(&all, 50.0) / 1000.0,
+           hist_percentile(&all, 99.0) / 1000.0,
+           hist_percentile(&all, 99.9) / 1000.0,
+           all.max / 1000.0,
+           (double)syscalls / (double)cfg->count);
+}
+
+static void run(const char* transport, const struct bench_config* cfg) {
+    int legacy = strcmp(transport, "sem") == 0;
+    int readers = legacy ? 1 : cfg->readers;  // The legacy array has one reader
+    struct room_segment room = {.shmid = -1, .fd = -1};
+    void* seg;
+
+    struct bench_result* results = mmap(NULL, sizeof(struct bench_result) * (size_t)(readers + 1),
+                                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap failed");
+        exit(1);
+    }
+    if (legacy) {
+        room.shmid = shmget(IPC_PRIVATE, sizeof(struct legacy_seg), IPC_CREAT | 0600);
+        if (room.shmid == -1) {
+            perror("shmget failed");
+            exit(1);
+        }
+        seg = shmat(room.shmid, NULL, 0);
+        if (seg == (void*)-1) {
+            perror("shmat failed");
+            exit(1);
+        }
+        room.shm = seg;
+        room.backend = ROOM_SHM_SYSV;
+    } else {
+        // The room's own segment code, so --shm, --ring-slots, --hugepages
+        // and --mlock apply
+        if (segment_create(&room, NULL, 0) != 1) {
+            exit(1);
+        }
+        seg = room.shm;
+        room_format(seg, room_config.ring_capacity, room_config.arena_size);
+    }
+    int semid = private_semaphore();
+
+    // Readers join before anyone forks so none of them can miss a message
+    int indexes[BENCH_MAX_READERS];
+    if (!legacy) {
+        for (int r = 0; r < readers; r++) {
+            char name[MAX_USERNAME_LEN];
+            snprintf(name, sizeof(name), "reader%d", r);
+            indexes[r] = room_join(seg, semid, name, NULL);
+        }
+    }
+
+    for (int r = 0; r < readers; r++) {
+        if (fork() == 0) {
+            atomic_store(&chat_syscalls, 0);
+            if (legacy) {
+                legacy_consumer(seg, semid, cfg, &results[r + 1]);
+            } else {
+                ring_consumer(seg, indexes[r], cfg, &results[r + 1]);
+            }
+            chat_trace_flush();
+            _exit(0);
+        }
+    }
+    if (fork() == 0) {
+        atomic_store(&chat_syscalls, 0);
+        if (legacy) {
+            legacy_producer(seg, semid, cfg, &results[0]);
+        } else {
+            ring_producer(seg, cfg, &results[0]);
+        }
+        chat_trace_flush();
+        _exit(0);
+    }
+    while (wait(NULL) > 0) {
+    }
+
+    report(transport, cfg, readers, results);
+    if (!legacy) {
+        static const char* const pages[] = {"normal pages", "huge pages advised (THP)", "hugetlb pages"};
+        printf("       %s segment, %u slots, %lluK arena, %s%s\n", room_backend_name(room.backend),
+               room_config.ring_capacity, (unsigned long long)room_config.arena_size / 1024,
+               pages[room.pages], room.locked ? ", locked" : "");
+    }
+
+    cleanup_resources(&room, semid);
+    segment_detach(&room);
+    munmap(results, sizeof(struct bench_result) * (size_t)(readers + 1));
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [--transport ring|sem|all] [--count N] [--sizes S1,S2,...] [--readers R]\n", prog);
+    printf("       %s --gateway SOCKET [--subscribers N] [--count N] [--sizes S1,S2,...]\n", prog);
+    printf("       %s --text\n", prog);
+    printf("  --transport  ring: lock-free room ring, sem: legacy semaphore-guarded array,\n");
+    printf("               all: run both for comparison (default)\n");
+    printf("  --count      messages to send (default %d)\n", BENCH_DEFAULT_COUNT);
+    printf("  --sizes      payload sizes in bytes, cycled through (default 16,200,4096);\n");
+    printf("               the sem transport caps payloads at %d bytes\n", MAX_MESSAGE_LEN - 1);
+    printf("  --readers    consumer processes for the ring transport (default 1)\n");
+    printf("  --gateway    measure fan-out through a running chatd listening on SOCKET\n");
+    printf("  --subscribers  gateway clients, all served from this process (default 1000)\n");
+    printf("  --text       benchmark UTF-8 validation, sanitizing and exit-command checks instead\n");
+    printf("Segment options for the ring transport:\n");
+    room_config_usage();
+}
+
+int main(int argc, char* argv[]) {
+    struct bench_config cfg = {
+        .transport = "all",
+        .count = BENCH_DEFAULT_COUNT,
+        .sizes = {16, 200, 4096},
+        .size_count = 3,
+        .readers = 1,
+        .subscribers = 1000,
+    };
+    int count_set = 0;
+
+    if (!room_config_parse(&argc, argv)) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            cfg.transport = argv[++i];
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            cfg.count = strtoull(argv[++i], NULL, 10);
+            count_set = 1;
+        } else if (strcmp(argv[i], "--text") == 0) {
+            cfg.transport = "text";
+        } else if (strcmp(argv[i], "--gateway") == 0 && i + 1 < argc) {
+            cfg.transport = "gateway";
+            cfg.gateway = argv[++i];
+        } else if (strcmp(argv[i], "--subscribers") == 0 && i + 1 < argc) {
+            cfg.subscribers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            cfg.readers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            cfg.size_count = 0;
+            for (char* tok = strtok(argv[++i], ","); tok && cfg.size_count < BENCH_MAX_SIZES;
+                 tok = strtok(NULL, ",")) {
+                cfg.sizes[cfg.size_count++] = strtoul(tok, NULL, 10);
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.count == 0 || cfg.size_count == 0 || cfg.readers < 1 || cfg.readers > BENCH_MAX_READERS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(cfg.transport, "text") == 0) {
+        run_text();
+        return 0;
+    }
+    if (strcmp(cfg.transport, "gateway") == 0) {
+        if (cfg.subscribers < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!count_set) {
+            cfg.count = GATEWAY_COUNT;
+        }
+        run_gateway(&cfg);
+        return 0;
+    }
+    if (strcmp(cfg.transport, "ring") != 0 && strcmp(cfg.transport, "sem") != 0 &&
+        strcmp(cfg.transport, "all") != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%-6s %7s %14s %10s %12s %9s %9s %9s %9s %12s\n",
+           "mode", "readers", "sizes", "messages", "msgs/sec",
+           "p50(us)", "p99(us)", "p999(us)", "max(us)", "syscalls/msg");
+    if (strcmp(cfg.transport, "all") == 0 || strcmp(cfg.transport, "ring") == 0) {
+        run("ring", &cfg);
+    }
+    if (strcmp(cfg.transport, "all") == 0 || strcmp(cfg.transport, "sem") == 0) {
+        run("sem", &cfg);
+    }
+    return 0;
+}
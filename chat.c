@@ -0,0 +1,173 @@
+/*
+ * chat.c
+ * OS Chat System - room client
+ * One binary for every member: the username is given on the command line
+ * and any number of members (up to MAX_USERS) can share the room.
+ */
+
+#include "chat_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define HISTORY_SIZE 5
+static char input_history[HISTORY_SIZE][MAX_MESSAGE_LEN];
+static int history_index = 0;
+
+/* Globals initialized to invalid states for safety */
+static ChatSession session;
+static volatile sig_atomic_t interrupted = 0;
+
+// Function declarations
+void show_message_history(void);
+void remember_input(const char* input);
+
+/* Signal handler: let the event loop leave the room cleanly */
+void signal_handler(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--history N] <username>\n", prog);
+    printf("       %s --history N\n", prog);
+    printf("       %s --search TEXT\n", prog);
+    printf("  username:    1-%d characters, unique within the room\n", MAX_USERNAME_LEN - 1);
+    printf("  --history N: print the last N messages from the journal first\n");
+    printf("  --search TEXT: print log lines containing TEXT, rotated logs included\n");
+    printf("When stdin is not a terminal (%s alice < script.txt) lines are sent in\n", prog);
+    printf("batches and neither the prompt nor your own lines are echoed.\n");
+    printf("Room segment options (every member must use the same --shm):\n");
+    room_config_usage();
+}
+
+int main(int argc, char *argv[]) {
+    const char *username = NULL;
+    const char *search = NULL;
+    long history = 0;
+
+    if (!room_config_parse(&argc, argv)) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            char *end;
+            history = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || history <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc) {
+            search = argv[++i];
+        } else if (!username && argv[i][0] != '-') {
+            username = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* History-only modes: no need to touch the room at all */
+    if (search) {
+        if (username || history > 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        search_log_history(search);
+        return 0;
+    }
+    if (!username && history > 0) {
+        show_journal_history((size_t)history);
+        return 0;
+    }
+    if (!username || strlen(username) >= MAX_USERNAME_LEN) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *color = user_color(username);
+    struct chat_render *out = render_stdout();
+    char event[128];
+
+    /* Handle interrupt signals; no SA_RESTART so poll() returns EINTR */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    setup_unicode();
+
+    display_welcome(username, color);
+    render_line(out, SYSTEM_COLOR, "Welcome to the OS Chat System!");
+    render_line(out, SYSTEM_COLOR, "========================================");
+    render_flush(out);
+    if (history > 0) {
+        show_journal_history((size_t)history);
+    }
+    snprintf(event, sizeof(event), "%s process started", username);
+    log_system_event(event);
+
+    /* Create the room, or attach to the one already running, and join it */
+    if (!chat_open(&session, username)) {
+        return 1;
+    }
+    render_line(out, SUCCESS_COLOR, "Connected to chat room (%u member(s) online).",
+                session.shm->participant_count);
+    if (session.resumed) {
+        render_line(out, SUCCESS_COLOR, "Resumed your previous session: %u message(s) were waiting.",
+                    atomic_load(&session.shm->head) - atomic_load(&session.me->cursor));
+    }
+    render_line(out, SYSTEM_COLOR, "Type /help for commands, such as /search <words>.");
+    render_line(out, SYSTEM_COLOR, "Type 'exit', 'bye', 'quit', or 'q' to leave.\n");
+    snprintf(event, sizeof(event), session.resumed ? "%s rejoined the chat" : "%s joined the chat",
+             username);
+    log_system_event(event);
+
+    struct chat_client client = {
+        .name = username,
+        .color = color,
+        .session = &session,
+        .interrupted = &interrupted,
+        .on_sent = remember_input,
+        .on_history = show_message_history,
+        .pipe_mode = !isatty(STDIN_FILENO),
+    };
+    chat_client_send(&client, event, MSG_TYPE_SYSTEM);
+
+    /*
+     * Members publish into one lock-free broadcast ring and each reads it
+     * through its own cursor, so neither sending nor receiving takes a lock.
+     */
+    chat_client_run(&client);
+
+    render_line(out, SYSTEM_COLOR, "Cleaning up %s...", username);
+    render_flush(out);
+    snprintf(event, sizeof(event), "%s process ending", username);
+    log_system_event(event);
+
+    /* The last member out removes the room */
+    chat_close(&session);
+
+    return 0;
+}
+
+// Store message in history
+void remember_input(const char* input) {
+    if (history_index < HISTORY_SIZE) {
+        strncpy(input_history[history_index], input, MAX_MESSAGE_LEN-1);
+        input_history[history_index][MAX_MESSAGE_LEN-1] = '\0';
+        history_index++;
+    }
+}
+
+void show_message_history() {
+    struct chat_render* out = render_stdout();
+    render_line(out, INFO_COLOR, "Recent messages you sent:");
+    for (int i = 0; i < history_index; i++) {
+        render_str(out, "  ");
+        render_line(out, COLOR_DIM, "%d. %s", i + 1, input_history[i]);
+    }
+    render_flush(out);
+}
@@ -0,0 +1,273 @@
+#ifndef CHAT_ARCHIVE_H
+#define CHAT_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Rotated log generations.
+//
+// Rotating chat_history.log renames it to chat_history.log.N, where N is one
+// past the highest generation on disk, so older generations are never
+// overwritten. A background thread later gzips chat_history.log.N into
+// chat_history.log.N.gz and removes the raw file; only the newest
+// CHAT_LOG_RETAIN generations are kept. zlib reads plain files through the
+// same gzread() interface, so searching walks raw and compressed
+// generations alike, streaming each one without unpacking it to disk.
+
+#define ARCHIVE_MAX_GENERATIONS 4096
+#define ARCHIVE_CHUNK           (64 * 1024)
+#define ARCHIVE_PATH_MAX        512
+
+struct archive_generation {
+    uint32_t number;
+    int compressed;
+};
+
+static inline int archive_generation_cmp(const void* a, const void* b) {
+    const struct archive_generation* x = a;
+    const struct archive_generation* y = b;
+    if (x->number != y->number) {
+        return x->number < y->number ? -1 : 1;
+    }
+    return x->compressed - y->compressed;
+}
+
+// Split path into its directory (for opendir) and file name
+static inline const char* archive_basename(const char* path, char* dir, size_t dir_len) {
+    const char* slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(dir, dir_len, ".");
+        return path;
+    }
+    snprintf(dir, dir_len, "%.*s", (int)(slash - path), path);
+    return slash + 1;
+}
+
+// Fill gens with the generations of path that exist on disk, oldest first.
+// A generation caught mid-compression shows up twice, raw and compressed.
+// Returns how many were found.
+static inline size_t archive_list(const char* path, struct archive_generation* gens, size_t max) {
+    char dir[256];
+    const char* base = archive_basename(path, dir, sizeof(dir));
+    size_t base_len = strlen(base);
+    size_t count = 0;
+
+    DIR* d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL && count < max) {
+        const char* name = entry->d_name;
+        if (strncmp(name, base, base_len) != 0 || name[base_len] != '.') {
+            continue;
+        }
+        char* end;
+        unsigned long number = strtoul(name + base_len + 1, &end, 10);
+        if (end == name + base_len + 1 || number == 0 || number > UINT32_MAX) {
+            continue;
+        }
+        if (*end == '\0') {
+            gens[count++] = (struct archive_generation){(uint32_t)number, 0};
+        } else if (strcmp(end, ".gz") == 0) {
+            gens[count++] = (struct archive_generation){(uint32_t)number, 1};
+        }
+    }
+    closedir(d);
+    qsort(gens, count, sizeof(gens[0]), archive_generation_cmp);
+    return count;
+}
+
+static inline void archive_generation_path(char* out, size_t len, const char* path,
+                                           const struct archive_generation* gen) {
+    snprintf(out, len, "%s.%u%s", path, gen->number, gen->compressed ? ".gz" : "");
+}
+
+// Move the live file aside as the next generation. The caller serializes
+// rotations between processes. Returns the new generation number, or 0.
+static inline uint32_t archive_rotate(const char* path) {
+    static struct archive_generation gens[ARCHIVE_MAX_GENERATIONS];
+    size_t count = archive_list(path, gens, ARCHIVE_MAX_GENERATIONS);
+    struct archive_generation next = {count ? gens[count - 1].number + 1 : 1, 0};
+    char target[ARCHIVE_PATH_MAX];
+
+    archive_generation_path(target, sizeof(target), path, &next);
+    return rename(path, target) == 0 ? next.number : 0;
+}
+
+// gzip one raw generation next to itself and remove the original. The
+// temporary file is created with O_EXCL, so if two members race for the
+// same generation only one compresses it. Returns 1 if it was compressed.
+static inline int archive_compress(const char* raw, int level) {
+    if (strlen(raw) >= ARCHIVE_PATH_MAX) {
+        return 0;
+    }
+    char tmp[ARCHIVE_PATH_MAX + 16], gz[ARCHIVE_PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.gz.tmp", raw);
+    snprintf(gz, sizeof(gz), "%s.gz", raw);
+
+    int in = open(raw, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        return 0;
+    }
+    int out = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out == -1) {
+        close(in);
+        return 0;
+    }
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", level);
+    gzFile zf = gzdopen(out, mode);
+    if (!zf) {
+        close(out);
+        close(in);
+        unlink(tmp);
+        return 0;
+    }
+
+    char* chunk = malloc(ARCHIVE_CHUNK);
+    int ok = chunk != NULL;
+    ssize_t n;
+    while (ok && (n = read(in, chunk, ARCHIVE_CHUNK)) != 0) {
+        if (n == -1) {
+            ok = errno == EINTR;
+            continue;
+        }
+        ok = gzwrite(zf, chunk, (unsigned)n) == (int)n;
+    }
+    free(chunk);
+    close(in);
+    if (gzclose(zf) != Z_OK) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, gz) != 0) {
+        unlink(tmp);
+        return 0;
+    }
+    unlink(raw);
+    return 1;
+}
+
+// Compress every raw generation of path (including ones left behind by a
+// member that exited mid-rotation), then drop all but the newest `retain`
+// generations. Safe to run from several processes at once.
+static inline void archive_maintain(const char* path, int level, uint32_t retain) {
+    static struct archive_generation gens[ARCHIVE_MAX_GENERATIONS];
+    size_t count = archive_list(path, gens, ARCHIVE_MAX_GENERATIONS);
+    char gen_path[ARCHIVE_PATH_MAX];
+
+    for (size_t i = 0; i < count; i++) {
+        if (gens[i].compressed) {
+            continue;
+        }
+        archive_generation_path(gen_path, sizeof(gen_path), path, &gens[i]);
+        if (i + 1 < count && gens[i + 1].number == gens[i].number) {
+            // The .gz is only renamed into place once complete, so the raw
+            // copy is just left over from an interrupted cleanup
+            unlink(gen_path);
+        } else {
+            archive_compress(gen_path, level);
+        }
+    }
+
+    count = archive_list(path, gens, ARCHIVE_MAX_GENERATIONS);
+    uint32_t distinct = 0;
+    for (size_t i = count; i-- > 0; ) {
+        if (i + 1 == count || gens[i].number != gens[i + 1].number) {
+            distinct++;
+        }
+        if (distinct > retain) {
+            archive_generation_path(gen_path, sizeof(gen_path), path, &gens[i]);
+            unlink(gen_path);
+        }
+    }
+}
+
+// Stream one file (gzip or plain) line by line, calling on_match for each
+// line containing needle. Lines may be as long as a maximum-size message,
+// so the line buffer grows as needed. Returns the number of matches.
+static inline size_t archive_grep_file(const char* file, const char* needle,
+                                       void (*on_match)(const char* file, const char* line, size_t len)) {
+    gzFile zf = gzopen(file, "rb");
+    if (!zf) {
+        return 0;
+    }
+    gzbuffer(zf, ARCHIVE_CHUNK);
+
+    size_t matches = 0;
+    size_t cap = 4096, len = 0;
+    char* line = malloc(cap);
+    char* chunk = malloc(ARCHIVE_CHUNK);
+    int n = 0;
+
+    while (line && chunk && (n = gzread(zf, chunk, ARCHIVE_CHUNK)) >= 0) {
+        char* p = chunk;
+        char* end = chunk + n;
+        // At end of file, treat an unterminated last line as complete
+        while (p < end || (n == 0 && len > 0)) {
+            char* nl = p < end ? memchr(p, '\n', (size_t)(end - p)) : NULL;
+            size_t take = nl ? (size_t)(nl - p) : (size_t)(end - p);
+            if (len + take + 1 > cap) {
+                while (len + take + 1 > cap) {
+                    cap *= 2;
+                }
+                char* grown = realloc(line, cap);
+                if (!grown) {
+                    n = -1;
+                    break;
+                }
+                line = grown;
+            }
+            memcpy(line + len, p, take);
+            len += take;
+            p += take;
+            if (!nl && n != 0) {
+                break;  // Line continues in the next chunk
+            }
+            line[len] = '\0';
+            if (strstr(line, needle)) {
+                on_match(file, line, len);
+                matches++;
+            }
+            len = 0;
+            if (nl) {
+                p++;
+            }
+        }
+        if (n <= 0) {
+            break;
+        }
+    }
+    free(chunk);
+    free(line);
+    gzclose(zf);
+    return matches;
+}
+
+// Search every generation of path, oldest first, then the live file
+static inline size_t archive_grep(const char* path, const char* needle,
+                                  void (*on_match)(const char* file, const char* line, size_t len)) {
+    static struct archive_generation gens[ARCHIVE_MAX_GENERATIONS];
+    size_t count = archive_list(path, gens, ARCHIVE_MAX_GENERATIONS);
+    size_t matches = 0;
+    char gen_path[ARCHIVE_PATH_MAX];
+
+    for (size_t i = 0; i < count; i++) {
+        // Mid-compression duplicates: the raw file is complete, the .gz may not be
+        if (gens[i].compressed && i > 0 && gens[i - 1].number == gens[i].number) {
+            continue;
+        }
+        archive_generation_path(gen_path, sizeof(gen_path), path, &gens[i]);
+        matches += archive_grep_file(gen_path, needle, on_match);
+    }
+    return matches + archive_grep_file(path, needle, on_match);
+}
+
+#endif
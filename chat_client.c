@@ -0,0 +1,1047 @@
+/*
+ * chat_client.c
+ * OS Chat System - interactive client
+ * Terminal display helpers and the event loop shared by every member:
+ * stdin and every joined channel are polled together and typed lines go
+ * out in batches.
+ */
+
+#include "chat_common.h"
+
+// What the main room is called in /join and in channel tags
+#define CHAT_MAIN_CHANNEL "lobby"
+
+// Check if message is an exit command
+int is_exit_command(const char* message) {
+    return command_lookup(message, strlen(message), NULL) == CMD_QUIT;
+}
+
+// Display welcome message
+void display_welcome(const char* username, const char* color) {
+    struct chat_render* out = render_stdout();
+    render_append(out, "\n", 1);
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "╔══════════════════════════════════════════════════════════════╗");
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "║                    CHAT SYSTEM v%s                         ║", VERSION);
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "║                                                              ║");
+    render_color(out, COLOR_BOLD);
+    render_color(out, color);
+    render_str(out, "║  Welcome ");
+    render_color(out, COLOR_WHITE);
+    render_format(out, "%-20s", username);
+    render_line(out, color, "!                                    ║");
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "║                                                              ║");
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "║  Commands: /help, exit, bye, quit, q                       ║");
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "║  Type your messages below...                               ║");
+    render_color(out, COLOR_BOLD);
+    render_line(out, color, "╚══════════════════════════════════════════════════════════════╝");
+    render_append(out, "\n", 1);
+    render_flush(out);
+}
+
+// Show a typing indicator for half a second. Returns at once: the client's
+// event loop takes it down when the timer runs out.
+void display_typing_indicator(const char* username, const char* color) {
+    struct chat_render* out = render_stdout();
+    render_typing(out, username, color, 500);
+    render_flush(out);
+}
+
+// Display message with proper formatting
+void display_message(const char* sender, const char* message, const char* color, int is_own) {
+    struct chat_render* out = render_stdout();
+    render_message(out, sender, message, strlen(message), color, is_own);
+    render_flush(out);
+}
+
+// Repair invalid UTF-8 and blank out control characters in place
+void sanitize_input(char* input) {
+    text_sanitize(input, strlen(input));
+}
+
+// Pick a stable display color for a member name
+const char* user_color(const char* name) {
+    static const char* palette[] = {
+        COLOR_CYAN, COLOR_GREEN, COLOR_MAGENTA, COLOR_BLUE, COLOR_WHITE,
+    };
+    uint32_t hash = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return palette[hash % (sizeof(palette) / sizeof(palette[0]))];
+}
+
+/* ---- Channels ---- */
+
+// The channel typed lines go to. The main room is channel 0, set up the
+// first time anything asks.
+static struct chat_channel* chat_client_active(struct chat_client* client) {
+    if (client->channel_count == 0) {
+        memset(&client->channels[0], 0, sizeof(client->channels[0]));
+        client->channels[0].session = client->session;
+        client->channels[0].efd = -1;
+        client->channel_count = 1;
+        client->active = 0;
+    }
+    return &client->channels[client->active];
+}
+
+static const char* channel_label(const struct chat_channel* ch) {
+    return ch->name[0] != '\0' ? ch->name : CHAT_MAIN_CHANNEL;
+}
+
+// Tag a line with the channel it belongs to, once there is more than one
+static void chat_client_tag(struct chat_client* client, const struct chat_channel* ch) {
+    if (client->channel_count > 1) {
+        struct chat_render* out = render_stdout();
+        render_color(out, COLOR_DIM);
+        render_format(out, "#%s ", channel_label(ch));
+        render_color(out, COLOR_RESET);
+    }
+}
+
+// Channel traffic goes into the text log under "name #channel"
+static void chat_client_log(const struct chat_channel* ch, const char* sender, const char* content) {
+    if (ch->name[0] == '\0') {
+        log_message(sender, content);
+        return;
+    }
+    char who[MAX_USERNAME_LEN + CHAT_CHANNEL_NAME_MAX + 2];
+    snprintf(who, sizeof(who), "%.*s #%s", MAX_USERNAME_LEN, sender, ch->name);
+    log_message(who, content);
+}
+
+static void chat_client_prompt(struct chat_client* client) {
+    if (client->pipe_mode) {
+        return;
+    }
+    struct chat_render* out = render_stdout();
+    render_color(out, client->color);
+    if (client->channel_count > 1) {
+        render_format(out, "%s #%s > ", client->name, channel_label(chat_client_active(client)));
+    } else {
+        render_format(out, "%s > ", client->name);
+    }
+    render_color(out, COLOR_RESET);
+}
+
+// Format and log everything new at our cursor in one channel; the caller
+// flushes the whole burst at once. Returns nonzero if anything was shown.
+static int chat_client_drain(struct chat_client* client, struct chat_channel* ch) {
+    struct chat_render* out = render_stdout();
+    ChatSession* session = ch->session;
+    struct chat_message msg;
+    int shown = 0;
+
+    for (; room_read(session->shm, session->me, &msg); room_advance(session->shm, session->me)) {
+        // Our own messages were already shown when we sent them
+        if (msg.sender_id == session->me->id) {
+            continue;
+        }
+        stat_add(&session->me->received, 1);
+        // Everything formatted here is on screen after this pass's flush
+        room_mark_read(session->shm, session->me, &msg);
+        if (!shown) {
+            render_clear_line(out);  // The pending prompt
+            shown = 1;
+        }
+
+        if (msg.type == MSG_TYPE_SYSTEM) {
+            chat_client_tag(client, ch);
+            render_color(out, SYSTEM_COLOR);
+            render_text(out, msg.content, msg.length);
+            render_color(out, COLOR_RESET);
+            render_append(out, "\n", 1);
+            continue;
+        }
+
+        if (msg.length > 0) {
+            chat_client_tag(client, ch);
+            render_message(out, msg.sender, msg.content, msg.length, user_color(msg.sender), 0);
+            chat_client_log(ch, msg.sender, msg.content);
+        }
+        if (msg.type == MSG_TYPE_EXIT) {
+            char event[64];
+            chat_client_tag(client, ch);
+            if (ch->name[0] != '\0') {
+                render_line(out, SYSTEM_COLOR, "%s has left #%s.", msg.sender, ch->name);
+                snprintf(event, sizeof(event), "%s left #%s", msg.sender, ch->name);
+            } else {
+                render_line(out, SYSTEM_COLOR, "%s has left the chat.", msg.sender);
+                snprintf(event, sizeof(event), "%s left the chat", msg.sender);
+            }
+            log_system_event(event);
+        }
+    }
+    return shown;
+}
+
+// Journal and count n messages that just went out as IDs first, first + 1...
+// Only the main room is journaled: journal IDs are one room's epoch and
+// sequence, and must keep ascending.
+static void chat_client_published(struct chat_channel* ch, const struct chat_outgoing* msgs, size_t n,
+                                  uint32_t first) {
+    ChatSession* session = ch->session;
+
+    for (size_t i = 0; i < n && ch->name[0] == '\0'; i++) {
+        if (msgs[i].length > 0) {
+            journal_append(session->shm->epoch << 32 | (uint32_t)(first + i), msgs[i].type,
+                           session->username, msgs[i].content, msgs[i].length);
+        }
+    }
+    stat_add(&session->me->sent, n);
+    ch->last_sent_id = first + (uint32_t)n - 1;
+}
+
+static void chat_client_wait_outbox(struct chat_client* client, struct chat_channel* ch);
+
+// Publish count messages into one channel in order, after anything still
+// in its outbox, claiming ring slots for as many at a time as fit and
+// waiting for space if some member has fallen behind. Returns how many were
+// sent: fewer than count only if msgs[returned] can never fit in the arena.
+static size_t chat_channel_send_batch(struct chat_client* client, struct chat_channel* ch,
+                                      const struct chat_outgoing* msgs, size_t count) {
+    const struct timespec recheck = {1, 0};
+    struct chat_render* out = render_stdout();
+    ChatSession* session = ch->session;
+    struct shmseg* shm = session->shm;
+    size_t sent = 0;
+
+    chat_client_wait_outbox(client, ch);
+    while (sent < count) {
+        uint32_t tail = atomic_load(&shm->tail);
+        uint32_t first;
+        size_t n = room_publish_batch(shm, session->me, msgs + sent, count - sent, &first);
+        if (n == 0) {
+            // Our own cursor may be what is holding the ring up
+            chat_client_drain(client, ch);
+            n = room_publish_batch(shm, session->me, msgs + sent, count - sent, &first);
+        }
+        if (n == 0) {
+            render_line(out, ERROR_COLOR, "Message queue is full. Waiting for other users to read messages...");
+            render_flush(out);
+            if (!room_wait_writable(shm, tail, &recheck) &&
+                !room_recover(shm, session->semid) &&
+                atomic_load(&shm->head) == room_reclaim(shm)) {
+                // Nobody is behind, so nothing more will be freed: the arena
+                // is too fragmented for a body this large
+                render_line(out, ERROR_COLOR, "Not enough free shared memory for this message.");
+                break;
+            }
+            continue;
+        }
+
+        chat_client_published(ch, msgs + sent, n, first);
+        sent += n;
+    }
+    return sent;
+}
+
+static int chat_channel_send(struct chat_client* client, struct chat_channel* ch, const char* input, int type) {
+    struct chat_outgoing msg = {input, strlen(input), type};
+    return chat_channel_send_batch(client, ch, &msg, 1) == 1;
+}
+
+// Publish count messages in order into the current channel; see
+// chat_channel_send_batch()
+size_t chat_send_batch(struct chat_client* client, const struct chat_outgoing* msgs, size_t count) {
+    return chat_channel_send_batch(client, chat_client_active(client), msgs, count);
+}
+
+// Publish one message. Returns 0 only if it can never fit in the arena.
+int chat_client_send(struct chat_client* client, const char* input, int type) {
+    return chat_channel_send(client, chat_client_active(client), input, type);
+}
+
+// The logger thread counts bytes in-process; fold what it wrote since the
+// last call into the room stats while the segment is still attached
+static void chat_client_report_logged(struct chat_client* client) {
+    uint64_t logged = chat_logger_bytes_logged();
+    if (logged != client->logged_reported) {
+        stat_add(&client->session->shm->stats.bytes_logged, logged - client->logged_reported);
+        client->logged_reported = logged;
+    }
+}
+
+// Echo and log a line once it has been published
+static void chat_client_sent(struct chat_client* client, const struct chat_channel* ch, const char* input) {
+    if (client->on_sent) {
+        client->on_sent(input);
+    }
+    if (!client->pipe_mode) {
+        chat_client_tag(client, ch);
+        render_message(render_stdout(), client->name, input, strlen(input), client->color, 1);
+    }
+    chat_client_log(ch, client->name, input);
+}
+
+/* ---- Outbox ---- */
+
+// Publish typed lines without ever waiting: as many as the ring takes now,
+// each echoed once it is out. Returns how many went out.
+static size_t chat_client_try_publish(struct chat_client* client, struct chat_channel* ch,
+                                      const struct chat_outgoing* msgs, size_t count) {
+    ChatSession* session = ch->session;
+    size_t sent = 0;
+    int drained = 0;
+
+    while (sent < count) {
+        uint32_t first;
+        size_t n = room_publish_batch(session->shm, session->me, msgs + sent, count - sent, &first);
+        if (n == 0) {
+            if (drained) {
+                break;
+            }
+            // Our own cursor may be what is holding the ring up
+            chat_client_drain(client, ch);
+            drained = 1;
+            continue;
+        }
+        chat_client_published(ch, msgs + sent, n, first);
+        for (size_t i = sent; i < sent + n; i++) {
+            chat_client_sent(client, ch, msgs[i].content);
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+static void chat_client_outbox_depth(struct chat_channel* ch) {
+    atomic_store_explicit(&ch->session->me->outbox_depth, ch->outbox ? ch->outbox->count : 0,
+                          memory_order_relaxed);
+}
+
+// The flusher: move a channel's outbox into its ring, a batch per ring
+// claim, for as long as there is space. Never waits. Returns how many lines
+// are still queued.
+static size_t chat_client_flush_outbox(struct chat_client* client, struct chat_channel* ch) {
+    struct chat_render* out = render_stdout();
+    struct shmseg* shm = ch->session->shm;
+    MessageBuffer* outbox = ch->outbox;
+    struct chat_outgoing msgs[CHAT_SEND_BATCH_MAX];
+
+    if (!outbox || outbox->count == 0) {
+        return 0;
+    }
+    while (outbox->count > 0) {
+        size_t n = 0;
+        for (; n < outbox->count && n < CHAT_SEND_BATCH_MAX; n++) {
+            const struct chat_message* m = buffer_peek(outbox, n);
+            msgs[n] = (struct chat_outgoing){m->content, m->length, m->type};
+        }
+        size_t sent = chat_client_try_publish(client, ch, msgs, n);
+        if (sent == 0) {
+            if (atomic_load(&shm->head) != room_reclaim(shm)) {
+                room_recover(shm, ch->session->semid);
+                break;  // Someone is behind: wait for them
+            }
+            // Nobody is behind, so nothing more will be freed: the arena is
+            // too fragmented for a body this large
+            render_line(out, ERROR_COLOR, "Not enough free shared memory for this message.");
+            sent = 1;
+        }
+        buffer_drop(outbox, sent);
+        stat_add(&ch->session->me->outbox_drained, sent);
+        ch->outbox_episode_drained += sent;
+    }
+    chat_client_outbox_depth(ch);
+
+    if (outbox->count == 0) {
+        double ms = (double)(chat_now_ns() - ch->outbox_since_ns) / 1e6;
+        chat_client_tag(client, ch);
+        render_line(out, INFO_COLOR, "Sent %llu queued message(s) in %.0f ms.",
+                    (unsigned long long)ch->outbox_episode_drained, ms);
+    }
+    return outbox->count;
+}
+
+// Hand typed lines to a channel without blocking: straight into the ring
+// while it has space and nothing is queued ahead of them, otherwise into
+// the channel's outbox for the flusher
+static void chat_client_post(struct chat_client* client, struct chat_channel* ch,
+                             const struct chat_outgoing* msgs, size_t count) {
+    struct chat_render* out = render_stdout();
+    MessageBuffer* outbox = ch->outbox;
+    size_t done = 0;
+
+    if (!outbox || outbox->count == 0) {
+        done = chat_client_try_publish(client, ch, msgs, count);
+    }
+    if (done == count) {
+        return;
+    }
+    if (!outbox) {
+        // No event loop yet to flush an outbox: send the old way
+        chat_channel_send_batch(client, ch, msgs + done, count - done);
+        return;
+    }
+    if (outbox->count == 0) {
+        ch->outbox_since_ns = chat_now_ns();
+        ch->outbox_episode_drained = 0;
+        chat_client_tag(client, ch);
+        render_line(out, INFO_COLOR, "The room is full. Your messages are queued and go out as members catch up.");
+    }
+    for (; done < count; done++) {
+        struct chat_message msg = {.content = msgs[done].content, .length = (uint32_t)msgs[done].length,
+                                   .type = msgs[done].type};
+        if (outbox->bytes + msg.length > CHAT_OUTBOX_MAX_BYTES || !buffer_push(outbox, &msg)) {
+            render_line(out, ERROR_COLOR, "Outbox full (%zu messages waiting). Message dropped.", outbox->count);
+        }
+    }
+    chat_client_outbox_depth(ch);
+}
+
+// Block until a channel's outbox is empty, for messages that must follow it
+// in order, such as our exit. An interrupt gives up on what is left.
+static void chat_client_wait_outbox(struct chat_client* client, struct chat_channel* ch) {
+    const struct timespec recheck = {1, 0};
+    struct chat_render* out = render_stdout();
+    struct shmseg* shm = ch->session->shm;
+    int reported = 0;
+
+    while (ch->outbox && ch->outbox->count > 0) {
+        uint32_t tail = atomic_load(&shm->tail);
+        if (chat_client_flush_outbox(client, ch) == 0) {
+            break;
+        }
+        if (*client->interrupted) {
+            render_line(out, ERROR_COLOR, "Dropped %zu queued message(s).", ch->outbox->count);
+            buffer_drop(ch->outbox, ch->outbox->count);
+            chat_client_outbox_depth(ch);
+            break;
+        }
+        if (!reported) {
+            render_line(out, INFO_COLOR, "Sending %zu queued message(s) first...", ch->outbox->count);
+            reported = 1;
+        }
+        render_flush(out);
+        room_wait_writable(shm, tail, &recheck);
+    }
+}
+
+static void chat_client_print_match(const struct journal_record* rec, void* arg) {
+    struct chat_render* out = arg;
+    char sender[MAX_USERNAME_LEN] = {0};
+    char stamp[32];
+    time_t when = (time_t)rec->timestamp;
+    struct tm tm_info;
+
+    memcpy(sender, journal_sender(rec), rec->sender_len < MAX_USERNAME_LEN ? rec->sender_len : MAX_USERNAME_LEN - 1);
+    localtime_r(&when, &tm_info);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M", &tm_info);
+    render_color(out, COLOR_DIM);
+    render_format(out, "[%s] ", stamp);
+    render_color(out, user_color(sender));
+    render_text(out, sender, strlen(sender));
+    render_append(out, ": ", 2);
+    render_color(out, COLOR_RESET);
+    render_text(out, journal_content(rec), rec->content_len);
+    render_append(out, "\n", 1);
+}
+
+/* ---- Commands (chat_commands.def) ---- */
+
+static int command_help(struct chat_client* client, const char* line, const char* args);
+
+// Look terms up in the journal's search index and show the newest matches
+static int command_search(struct chat_client* client, const char* line, const char* terms) {
+    struct chat_render* out = render_stdout();
+    (void)client;
+    (void)line;
+    if (*terms == '\0') {
+        render_line(out, INFO_COLOR, "Usage: /search <words>  (messages containing every word)");
+        return 0;
+    }
+
+    uint64_t start = chat_now_ns();
+    size_t total = search_history(terms, CHAT_SEARCH_RESULTS, chat_client_print_match, out);
+    double ms = (double)(chat_now_ns() - start) / 1e6;
+    if (total > CHAT_SEARCH_RESULTS) {
+        render_line(out, INFO_COLOR, "%zu matching message(s), newest %d shown (%.1f ms).", total,
+                    CHAT_SEARCH_RESULTS, ms);
+    } else {
+        render_line(out, INFO_COLOR, "%zu matching message(s) (%.1f ms).", total, ms);
+    }
+    return 0;
+}
+
+static int command_history(struct chat_client* client, const char* line, const char* args) {
+    (void)line;
+    (void)args;
+    if (client->on_history) {
+        client->on_history();
+    } else {
+        render_line(render_stdout(), INFO_COLOR, "No input history is kept in this session.");
+    }
+    return 0;
+}
+
+static int command_stats(struct chat_client* client, const char* line, const char* args) {
+    struct chat_render* out = render_stdout();
+    struct chat_channel* ch = chat_client_active(client);
+    struct shmseg* shm = ch->session->shm;
+    struct chat_participant* me = ch->session->me;
+    uint32_t head = atomic_load(&shm->head);
+    int members = 0, orphans = 0;
+    (void)line;
+    (void)args;
+
+    for (int i = 0; i < MAX_USERS; i++) {
+        uint32_t state = atomic_load(&shm->participants[i].state);
+        members += state == PARTICIPANT_ACTIVE;
+        orphans += state == PARTICIPANT_ORPHANED;
+    }
+    render_line(out, INFO_COLOR, "Room #%s: %d member(s), %d orphaned; %u message(s) published",
+                channel_label(ch), members, orphans, head);
+    render_line(out, INFO_COLOR, "Queue: %u of %u pending, full %llu time(s) (ring) and %llu (arena)",
+                head - atomic_load(&shm->tail), shm->header.ring_capacity,
+                (unsigned long long)atomic_load(&shm->stats.queue_full),
+                (unsigned long long)atomic_load(&shm->stats.arena_full));
+    render_line(out, INFO_COLOR, "You: %llu sent, %llu received, %u unread",
+                (unsigned long long)atomic_load(&me->sent), (unsigned long long)atomic_load(&me->received),
+                head - atomic_load(&me->cursor));
+
+    if (ch->outbox && ch->outbox->count > 0) {
+        double seconds = (double)(chat_now_ns() - ch->outbox_since_ns) / 1e9;
+        render_line(out, INFO_COLOR, "Outbox: %zu line(s), %zu bytes waiting; %.1f sent/s since it backed up",
+                    ch->outbox->count, ch->outbox->bytes,
+                    seconds > 0 ? (double)ch->outbox_episode_drained / seconds : 0.0);
+    } else {
+        render_line(out, INFO_COLOR, "Outbox: empty; %llu line(s) sent through it",
+                    (unsigned long long)atomic_load(&me->outbox_drained));
+    }
+
+    uint64_t deliveries;
+    uint64_t p50 = room_latency_percentile(shm, 50.0, &deliveries);
+    if (deliveries > 0) {
+        render_line(out, INFO_COLOR, "Delivery: %llu message(s), %.1f us median, %.1f us p99, %.1f us max",
+                    (unsigned long long)deliveries, (double)p50 / 1000.0,
+                    (double)room_latency_percentile(shm, 99.0, &deliveries) / 1000.0,
+                    (double)atomic_load(&shm->stats.latency_max_ns) / 1000.0);
+    }
+
+    uint64_t delivered, read;
+    if (ch->last_sent_id != 0 &&
+        room_message_acks(shm, ch->last_sent_id, &delivered, &read)) {
+        // Everyone else who was in the room when it went out
+        render_line(out, INFO_COLOR, "Your last message: delivered to %d, read by %d, of %d other member(s)",
+                    __builtin_popcountll(delivered), __builtin_popcountll(read), members - 1);
+    }
+    return 0;
+}
+
+static int command_who(struct chat_client* client, const char* line, const char* args) {
+    struct chat_render* out = render_stdout();
+    struct chat_channel* ch = chat_client_active(client);
+    struct shmseg* shm = ch->session->shm;
+    (void)line;
+    (void)args;
+
+    if (ch->name[0] != '\0') {
+        render_line(out, INFO_COLOR, "In #%s:", ch->name);
+    } else {
+        render_line(out, INFO_COLOR, "In the room:");
+    }
+    for (int i = 0; i < MAX_USERS; i++) {
+        struct chat_participant* p = &shm->participants[i];
+        uint32_t state = atomic_load(&p->state);
+        if (state == PARTICIPANT_FREE) {
+            continue;
+        }
+        char name[MAX_USERNAME_LEN];
+        memcpy(name, p->name, sizeof(name));
+        name[MAX_USERNAME_LEN - 1] = '\0';
+        render_str(out, "  ");
+        render_color(out, user_color(name));
+        render_text(out, name, strlen(name));
+        render_color(out, COLOR_RESET);
+        if (p == ch->session->me) {
+            render_str(out, " (you)");
+        } else if (state == PARTICIPANT_ORPHANED) {
+            render_str(out, " (disconnected)");
+        }
+        render_append(out, "\n", 1);
+    }
+    return 0;
+}
+
+static void chat_client_leave_channel(struct chat_client* client, int index);
+
+static int command_quit(struct chat_client* client, const char* line, const char* args) {
+    char event[64];
+    (void)args;
+
+    render_line(render_stdout(), SYSTEM_COLOR, "You are leaving the chat...");
+    snprintf(event, sizeof(event), "%s initiated exit", client->name);
+    log_system_event(event);
+    chat_client_active(client);
+    while (client->channel_count > 1) {
+        chat_client_leave_channel(client, client->channel_count - 1);
+    }
+    chat_client_send(client, line, MSG_TYPE_EXIT);
+    return CHAT_LEFT;
+}
+
+// The joined channel called name ("" or "lobby" for the main room), or -1
+static int chat_client_find_channel(struct chat_client* client, const char* name) {
+    if (strcmp(name, CHAT_MAIN_CHANNEL) == 0) {
+        name = "";
+    }
+    for (int i = 0; i < client->channel_count; i++) {
+        if (strcmp(client->channels[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The first word of a command's arguments, without a leading '#'.
+// Returns 0 if it is too long to be a channel name.
+static int channel_argument(const char* args, char* name) {
+    size_t len = 0;
+    if (*args == '#') {
+        args++;
+    }
+    while (args[len] != '\0' && args[len] != ' ') {
+        if (len == CHAT_CHANNEL_NAME_MAX - 1) {
+            return 0;
+        }
+        name[len] = args[len];
+        len++;
+    }
+    name[len] = '\0';
+    return 1;
+}
+
+// Say goodbye in a named channel, then close it and drop it from the list
+static void chat_client_leave_channel(struct chat_client* client, int index) {
+    struct chat_channel* ch = &client->channels[index];
+    char event[64];
+
+    chat_channel_send(client, ch, "", MSG_TYPE_EXIT);
+    snprintf(event, sizeof(event), "%s left #%s", client->name, ch->name);
+    log_system_event(event);
+    buffer_destroy(ch->outbox);
+    chat_close(ch->session);
+    free(ch->session);
+
+    memmove(ch, ch + 1, (size_t)(client->channel_count - index - 1) * sizeof(*ch));
+    client->channel_count--;
+    if (client->active == index) {
+        client->active = 0;
+    } else if (client->active > index) {
+        client->active--;
+    }
+}
+
+// Join a named channel: a room of its own, polled alongside the others
+// from now on. Returns its index, or -1.
+static int chat_client_join_channel(struct chat_client* client, const char* name) {
+    struct chat_render* out = render_stdout();
+    char event[64];
+
+    if (client->channel_count == CHAT_MAX_CHANNELS) {
+        render_line(out, ERROR_COLOR, "You are in %d channels already; /leave one first.", CHAT_MAX_CHANNELS);
+        return -1;
+    }
+    ChatSession* session = malloc(sizeof(*session));
+    if (!session) {
+        perror("malloc failed");
+        return -1;
+    }
+    // chat_open_channel() reports its errors with printf
+    render_flush(out);
+    if (!chat_open_channel(session, client->name, name)) {
+        free(session);
+        return -1;
+    }
+    int efd = chat_poll_fd(session);
+    if (efd == -1) {
+        chat_close(session);
+        free(session);
+        return -1;
+    }
+
+    int index = client->channel_count++;
+    struct chat_channel* ch = &client->channels[index];
+    memset(ch, 0, sizeof(*ch));
+    snprintf(ch->name, sizeof(ch->name), "%s", name);
+    ch->session = session;
+    ch->efd = efd;
+    ch->outbox = buffer_create(CHAT_SEND_BATCH_MAX);
+    if (!ch->outbox) {
+        perror("Failed to create outbox");
+    }
+
+    snprintf(event, sizeof(event), session->resumed ? "%s rejoined #%s" : "%s joined #%s",
+             client->name, name);
+    log_system_event(event);
+    chat_channel_send(client, ch, event, MSG_TYPE_SYSTEM);
+    return index;
+}
+
+static void chat_client_list_channels(struct chat_client* client) {
+    struct chat_render* out = render_stdout();
+
+    render_line(out, INFO_COLOR, "Your channels (lines you type go to the one marked *):");
+    for (int i = 0; i < client->channel_count; i++) {
+        struct chat_channel* ch = &client->channels[i];
+        render_line(out, COLOR_DIM, "  %c #%-*s %u member(s)", i == client->active ? '*' : ' ',
+                    CHAT_CHANNEL_NAME_MAX, channel_label(ch), ch->session->shm->participant_count);
+    }
+}
+
+static int command_join(struct chat_client* client, const char* line, const char* args) {
+    struct chat_render* out = render_stdout();
+    char name[CHAT_CHANNEL_NAME_MAX];
+    (void)line;
+
+    chat_client_active(client);
+    if (!channel_argument(args, name)) {
+        render_line(out, ERROR_COLOR, "Channel names are at most %d characters.", CHAT_CHANNEL_NAME_MAX - 1);
+        return 0;
+    }
+    if (name[0] == '\0') {
+        chat_client_list_channels(client);
+        return 0;
+    }
+    int index = chat_client_find_channel(client, name);
+    if (index == -1) {
+        if (!room_channel_valid(name)) {
+            render_line(out, ERROR_COLOR, "Channel names are lowercase letters, digits, '-' and '_'.");
+            return 0;
+        }
+        index = chat_client_join_channel(client, name);
+        if (index == -1) {
+            return 0;
+        }
+        render_line(out, SUCCESS_COLOR, "Joined #%s (%u member(s) online).", name,
+                    client->channels[index].session->shm->participant_count);
+    }
+    client->active = index;
+    render_line(out, INFO_COLOR, "Lines you type now go to #%s. /join %s switches back.",
+                channel_label(&client->channels[index]),
+                index == 0 ? "<channel>" : CHAT_MAIN_CHANNEL);
+    return 0;
+}
+
+static int command_leave(struct chat_client* client, const char* line, const char* args) {
+    struct chat_render* out = render_stdout();
+    char name[CHAT_CHANNEL_NAME_MAX];
+    (void)line;
+
+    chat_client_active(client);
+    int index = client->active;
+    if (!channel_argument(args, name)) {
+        index = -1;
+    } else if (name[0] != '\0') {
+        index = chat_client_find_channel(client, name);
+    }
+    if (index == -1) {
+        render_line(out, ERROR_COLOR, "You are not in that channel. /join lists yours.");
+        return 0;
+    }
+    if (index == 0) {
+        render_line(out, ERROR_COLOR, "That is the main room; /quit leaves the chat.");
+        return 0;
+    }
+    snprintf(name, sizeof(name), "%s", client->channels[index].name);
+    chat_client_leave_channel(client, index);
+    render_line(out, SYSTEM_COLOR, "You left #%s. Lines you type go to #%s.", name,
+                channel_label(chat_client_active(client)));
+    return 0;
+}
+
+static const struct {
+    const char* usage;
+    const char* help;
+} command_info[CMD_COUNT] = {
+#define CHAT_COMMAND(id, name, usage, help) [id] = {usage, help},
+#define CHAT_ALIAS(id, name)
+#include "chat_commands.def"
+#undef CHAT_COMMAND
+#undef CHAT_ALIAS
+};
+
+static int (*const command_handlers[CMD_COUNT])(struct chat_client*, const char*, const char*) = {
+    [CMD_HELP] = command_help,
+    [CMD_HISTORY] = command_history,
+    [CMD_SEARCH] = command_search,
+    [CMD_STATS] = command_stats,
+    [CMD_WHO] = command_who,
+    [CMD_JOIN] = command_join,
+    [CMD_LEAVE] = command_leave,
+    [CMD_QUIT] = command_quit,
+};
+
+static int command_help(struct chat_client* client, const char* line, const char* args) {
+    struct chat_render* out = render_stdout();
+    (void)client;
+    (void)line;
+    (void)args;
+
+    render_line(out, INFO_COLOR, "Commands:");
+    for (int i = 0; i < CMD_COUNT; i++) {
+        render_line(out, COLOR_DIM, "  %-16s %s", command_info[i].usage, command_info[i].help);
+    }
+    return 0;
+}
+
+// Whether the reader must hand this line to chat_client_handle_line()
+// instead of batching it as a message
+static int chat_client_is_command(const char* line, size_t len) {
+    return line[0] == '/' || command_lookup(line, len, NULL) != CMD_NONE;
+}
+
+int chat_client_handle_line(struct chat_client* client, const char* input) {
+    // Check for empty input (user just pressed Enter)
+    if (input[0] == '\0') {
+        return 0;
+    }
+
+    size_t len = strlen(input);
+    const char* args;
+    int command = command_lookup(input, len, &args);
+    if (command != CMD_NONE) {
+        return command_handlers[command](client, input, args);
+    }
+    if (input[0] == '/') {
+        struct chat_render* out = render_stdout();
+        render_color(out, ERROR_COLOR);
+        render_str(out, "Unknown command ");
+        render_text(out, input, command_key_len(input, len));
+        render_str(out, ". Type /help for the list.");
+        render_color(out, COLOR_RESET);
+        render_append(out, "\n", 1);
+        return 0;
+    }
+
+    struct chat_outgoing msg = {input, len, MSG_TYPE_NORMAL};
+    chat_client_post(client, chat_client_active(client), &msg, 1);
+    return 0;
+}
+
+static void line_batch_add(struct line_batch* batch, const char* line, size_t len) {
+    size_t need = batch->len + len + 1;
+    if (need > batch->cap) {
+        size_t cap = batch->cap ? batch->cap : 4096;
+        while (cap < need) {
+            cap *= 2;
+        }
+        char* grown = realloc(batch->data, cap);
+        if (!grown) {
+            perror("realloc failed");
+            return;
+        }
+        batch->data = grown;
+        batch->cap = cap;
+    }
+    memcpy(batch->data + batch->len, line, len);
+    batch->data[batch->len + len] = '\0';
+    batch->offsets[batch->count++] = batch->len;
+    batch->len = need;
+}
+
+// Send every batched line in as few ring claims as possible
+static void chat_client_flush_batch(struct chat_client* client, struct line_batch* batch) {
+    struct chat_outgoing msgs[CHAT_SEND_BATCH_MAX];
+
+    for (size_t i = 0; i < batch->count; i++) {
+        size_t end = i + 1 < batch->count ? batch->offsets[i + 1] : batch->len;
+        msgs[i] = (struct chat_outgoing){batch->data + batch->offsets[i], end - batch->offsets[i] - 1,
+                                         MSG_TYPE_NORMAL};
+    }
+    if (batch->count > 0) {
+        chat_client_post(client, chat_client_active(client), msgs, batch->count);
+    }
+    batch->len = 0;
+    batch->count = 0;
+}
+
+// Split whatever stdin has ready into lines. Complete lines are collected
+// and published together, so a pasted block or a piped script costs one
+// ring claim and one wakeup per batch rather than per line. Returns
+// CHAT_LEFT on an exit command, -1 on end of input.
+static int chat_client_read_input(struct chat_client* client, struct line_reader* reader) {
+    char chunk[64 * 1024];
+    struct line_batch* batch = &reader->batch;
+    ssize_t n = read(STDIN_FILENO, chunk, sizeof(chunk));
+    if (n == -1) {
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    }
+    if (n == 0) {
+        return -1;
+    }
+
+    for (char *p = chunk, *end = chunk + n; p < end; ) {
+        char* nl = memchr(p, '\n', (size_t)(end - p));
+        size_t take = (size_t)((nl ? nl : end) - p);
+
+        if (!reader->overflow) {
+            size_t need = reader->len + take + 1;
+            if (need > (size_t)CHAT_MAX_PAYLOAD + 1) {
+                reader->overflow = 1;
+            } else {
+                if (need > reader->cap) {
+                    size_t cap = reader->cap ? reader->cap : 256;
+                    while (cap < need) {
+                        cap *= 2;
+                    }
+                    char* grown = realloc(reader->line, cap);
+                    if (!grown) {
+                        perror("realloc failed");
+                        return -1;
+                    }
+                    reader->line = grown;
+                    reader->cap = cap;
+                }
+                memcpy(reader->line + reader->len, p, take);
+                reader->len += take;
+            }
+        }
+        if (!nl) {
+            break;
+        }
+
+        if (reader->overflow) {
+            render_line(render_stdout(), ERROR_COLOR, "Message too long! The limit is %d bytes.", CHAT_MAX_PAYLOAD);
+        } else if (reader->len > 0) {
+            reader->line[reader->len] = '\0';
+            text_sanitize(reader->line, reader->len);
+            if (chat_client_is_command(reader->line, reader->len)) {
+                // Everything typed before the command still goes out first
+                chat_client_flush_batch(client, batch);
+                if (chat_client_handle_line(client, reader->line) == CHAT_LEFT) {
+                    return CHAT_LEFT;
+                }
+            } else {
+                line_batch_add(batch, reader->line, reader->len);
+                if (batch->count == CHAT_SEND_BATCH_MAX || batch->len >= CHAT_MAX_PAYLOAD) {
+                    chat_client_flush_batch(client, batch);
+                }
+            }
+        }
+        reader->len = 0;
+        reader->overflow = 0;
+        p = nl + 1;
+    }
+    chat_client_flush_batch(client, batch);
+    return 0;
+}
+
+// Shared main loop: multiplexes stdin and the notifier of every joined
+// channel, so incoming messages are shown the moment they arrive in any of
+// them, and never blocks on input while touching shared memory. Always
+// leaves with an exit message so the other members learn we are gone.
+void chat_client_run(struct chat_client* client) {
+    struct chat_render* out = render_stdout();
+    struct chat_channel* main_room = chat_client_active(client);
+    struct line_reader reader = {0};
+    struct pollfd fds[1 + CHAT_MAX_CHANNELS];
+    int rc = 0;
+
+    main_room->efd = chat_poll_fd(client->session);
+    if (main_room->efd == -1) {
+        chat_client_send(client, "", MSG_TYPE_EXIT);
+        return;
+    }
+    main_room->outbox = buffer_create(CHAT_SEND_BATCH_MAX);
+    if (!main_room->outbox) {
+        perror("Failed to create outbox");
+    }
+
+    chat_client_prompt(client);
+    while (!*client->interrupted) {
+        // Whatever the last pass produced goes out as one write
+        render_flush(out);
+        int timeout = render_timeout(out);
+        int channels = client->channel_count;
+
+        fds[0] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+        for (int i = 0; i < channels; i++) {
+            struct chat_channel* ch = &client->channels[i];
+            fds[1 + i] = (struct pollfd){.fd = ch->efd, .events = POLLIN};
+            if (ch->outbox && ch->outbox->count > 0 && (timeout == -1 || timeout > CHAT_OUTBOX_RETRY_MS)) {
+                timeout = CHAT_OUTBOX_RETRY_MS;
+            }
+        }
+        int ready = poll(fds, (nfds_t)(1 + channels), timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            break;
+        }
+        if (render_tick(out)) {
+            chat_client_prompt(client);
+        }
+        for (int i = 0; i < channels; i++) {
+            struct chat_channel* ch = &client->channels[i];
+            if (chat_client_flush_outbox(client, ch) == 0 && ch->outbox_episode_drained > 0) {
+                ch->outbox_episode_drained = 0;
+                chat_client_prompt(client);
+            }
+        }
+        if (ready == 0) {
+            continue;
+        }
+        chat_client_report_logged(client);
+
+        int shown = 0;
+        for (int i = 0; i < channels; i++) {
+            if (fds[1 + i].revents & POLLIN) {
+                uint64_t count;
+                if (read(fds[1 + i].fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                    perror("eventfd read failed");
+                }
+                shown |= chat_client_drain(client, &client->channels[i]);
+            }
+        }
+        if (shown) {
+            chat_client_prompt(client);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            rc = chat_client_read_input(client, &reader);
+            if (rc != 0) {
+                break;
+            }
+            chat_client_prompt(client);
+        }
+    }
+
+    while (client->channel_count > 1) {
+        chat_client_leave_channel(client, client->channel_count - 1);
+    }
+    if (rc != CHAT_LEFT) {
+        render_append(out, "\n", 1);
+        render_line(out, SYSTEM_COLOR, "Leaving the chat...");
+        chat_client_send(client, "", MSG_TYPE_EXIT);
+    }
+    render_flush(out);
+    chat_client_report_logged(client);
+    buffer_destroy(main_room->outbox);
+    main_room->outbox = NULL;
+    chat_client_outbox_depth(main_room);
+    free(reader.line);
+    free(reader.batch.data);
+}
+
+//brief Initialize Unicode and locale support for international text
+ 
+void setup_unicode(void) {
+    if (setlocale(LC_ALL, "en_US.UTF-8") == NULL) {
+        // Fallback if UTF-8 locale is not available
+        setlocale(LC_ALL, "C");
+        struct chat_render* out = render_stdout();
+        render_line(out, COLOR_YELLOW, "Warning: UTF-8 locale not available, using basic locale");
+        render_flush(out);
+    }
+}
+
@@ -0,0 +1,87 @@
+#ifndef CHAT_COMMAND_H
+#define CHAT_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Command lookup.
+//
+// Every name in chat_commands.def hashes to its own slot of
+// command_table[], which gen_command_table writes out at build time after
+// searching for a seed with no collisions. Telling whether a line is a
+// command therefore costs a length check, one hash of the first word and
+// at most one compare, however many commands there are.
+
+enum chat_command_id {
+    CMD_NONE = -1,
+#define CHAT_COMMAND(id, name, usage, help) id,
+#define CHAT_ALIAS(id, name)
+#include "chat_commands.def"
+#undef CHAT_COMMAND
+#undef CHAT_ALIAS
+    CMD_COUNT
+};
+
+struct chat_command_slot {
+    const char* name;  // NULL for an empty slot
+    uint8_t len;
+    int8_t id;         // enum chat_command_id
+};
+
+// FNV-1a over the case-folded key, finished so the low bits mix in every
+// byte. Shared with the generator, which picks the seed.
+static inline uint32_t command_hash(const char* key, size_t len, uint32_t seed) {
+    uint32_t h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ ((unsigned char)key[i] | 0x20)) * 0x01000193u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+// The part of a line that names a command: the first word of a slash
+// command, otherwise the whole line
+static inline size_t command_key_len(const char* line, size_t len) {
+    if (len == 0 || line[0] != '/') {
+        return len;
+    }
+    size_t i = 1;
+    while (i < len && line[i] != ' ') {
+        i++;
+    }
+    return i;
+}
+
+#ifndef COMMAND_GENERATOR
+#include "chat_command_table.h"
+
+// Which command line invokes, or CMD_NONE. *args (if given) is set to the
+// text after the command name, without leading spaces.
+static inline int command_lookup(const char* line, size_t len, const char** args) {
+    size_t key = command_key_len(line, len);
+    if (key < COMMAND_MIN_LEN || key > COMMAND_MAX_LEN) {
+        return CMD_NONE;
+    }
+    const struct chat_command_slot* slot =
+        &command_table[command_hash(line, key, COMMAND_HASH_SEED) & (COMMAND_TABLE_SIZE - 1)];
+    if (slot->len != key) {
+        return CMD_NONE;
+    }
+    for (size_t i = 0; i < key; i++) {
+        if (((unsigned char)line[i] | 0x20) != (unsigned char)slot->name[i]) {
+            return CMD_NONE;
+        }
+    }
+    if (args) {
+        while (key < len && line[key] == ' ') {
+            key++;
+        }
+        *args = line + key;
+    }
+    return slot->id;
+}
+#endif
+
+#endif
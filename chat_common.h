@@ -1,6 +1,16 @@
+#ifndef CHAT_COMMON_H
+#define CHAT_COMMON_H
+
 #define _DEFAULT_SOURCE
 #define VERSION "2.1"
 #include "config.h"
+#include "chat_journal.h"
+#include "chat_archive.h"
+#include "chat_text.h"
+#include "chat_search.h"
+#include "chat_command.h"
+#include "chat_histogram.h"
+#include "chat_trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,16 +24,25 @@
 #include <sys/stat.h>
 #include <wchar.h>        
 #include <locale.h>  
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #ifndef MAX_MESSAGE_LEN
 #define MAX_MESSAGE_LEN 200
 #endif
 #define LOG_FILE "chat_history.log"
+#define SYSTEM_LOG_FILE "system.log"
 #define MAX_USERNAME_LEN 20
 
-// User names
-#define JAINEEL_NAME "Jaineel"
-#define GUL_NAME "Gul"
-
 // ANSI Color Codes
 #define COLOR_RESET   "\033[0m"
 #define COLOR_RED     "\033[31m"
@@ -36,9 +55,7 @@
 #define COLOR_BOLD    "\033[1m"
 #define COLOR_DIM     "\033[2m"
 
-// User-specific colors
-#define JAINEEL_COLOR COLOR_CYAN
-#define GUL_COLOR     COLOR_GREEN
+// Role colors (members get one from user_color())
 #define SYSTEM_COLOR  COLOR_YELLOW
 #define ERROR_COLOR   COLOR_RED
 #define INFO_COLOR    COLOR_BLUE
@@ -49,248 +66,497 @@
 #define MSG_TYPE_EXIT   1
 #define MSG_TYPE_SYSTEM 2
 
+// Log files handled by the background logger
+#define LOG_SINK_HISTORY 0
+#define LOG_SINK_SYSTEM  1
+#define LOG_SINK_JOURNAL 2
+#define LOG_SINK_COUNT   3
+
+// Logger fsync policies (CHAT_LOG_FSYNC in config.h)
+#define LOG_FSYNC_NEVER    0
+#define LOG_FSYNC_BATCH    1  // After every batch write
+#define LOG_FSYNC_INTERVAL 2  // At most once per CHAT_LOG_FSYNC_INTERVAL_MS
+
+// Growable FIFO of messages kept in process memory, such as the client's
+// outbox. Every entry owns a NUL-terminated heap copy of its content;
+// the ring doubles when it fills.
 typedef struct {
     struct chat_message* messages;
     size_t capacity;
     size_t count;
     size_t head;
     size_t tail;
+    size_t bytes;  // Content bytes held
 } MessageBuffer;
 
-typedef struct {
-    int shmid;
-    int semid;
-    struct shmseg* shm;
-    const char* username;
-    const char* color;
-    int last_seen_id;
-} ChatSession;
-
+// A received message. content points straight into the shared arena and is
+// NUL-terminated; it stays valid until the reader calls room_advance().
 struct chat_message {
-    char content[MAX_MESSAGE_LEN];
+    const char* content;
+    uint32_t length;
     char sender[MAX_USERNAME_LEN];
+    uint32_t sender_id;  // Interned sender, see struct chat_participant
     int type;  // MSG_TYPE_NORMAL, MSG_TYPE_EXIT, MSG_TYPE_SYSTEM
     int message_id;
+    uint64_t sent_ns;  // CLOCK_MONOTONIC time it was published
+};
+
+// A message to send. content need not be NUL-terminated.
+struct chat_outgoing {
+    const char* content;
+    size_t length;
+    int type;
+};
+
+// One entry of the room's broadcast ring. seq holds the message's sequence
+// number + 1 once it is published and 0 while a producer is (re)writing it,
+// so readers can both detect unpublished slots and notice being lapped.
+// The body lives in the arena; payload is (seq + 1) << 32 | arena block, so
+// whoever reclaims the block can tell which message it belonged to.
+//
+// delivered and read hold one bit per participant index: a reader sets its
+// delivered bit when room_read() first returns the message and its read bit
+// once it has shown it (room_mark_read()). Both are plain fetch-ors on the
+// slot, and a reader's cursor keeps the slot from being reused until it is
+// done, so acknowledging takes no lock and no extra pass over the ring.
+struct chat_slot {
+    _Atomic uint32_t seq;
+    int type;
+    uint32_t length;
+    uint32_t sender_id;
+    char sender[MAX_USERNAME_LEN];  // Kept for display after the sender leaves
+    _Atomic uint64_t payload;
+    uint64_t sent_ns;               // CLOCK_MONOTONIC time of publishing
+    _Atomic uint64_t delivered;
+    _Atomic uint64_t read;
+};
+
+_Static_assert(MAX_USERS <= 64, "acknowledgement masks hold one bit per member");
+
+// Shared-memory arena for message bodies, carved into power-of-two size
+// classes from ARENA_MIN_BLOCK up to CHAT_MAX_PAYLOAD. A block reference is
+// class << 28 | index, where index counts ARENA_MIN_BLOCK units from the
+// start of the arena (unit 0 is reserved so a reference is never 0). Blocks
+// are never split or merged: freed blocks go onto a lock-free per-class free
+// list whose head carries an ABA tag in its upper 32 bits.
+#define ARENA_MIN_BLOCK   64
+#define ARENA_CLASS_SHIFT 28
+#define ARENA_INDEX_MASK  ((1u << ARENA_CLASS_SHIFT) - 1)
+#define ARENA_CLASSES     16
+
+struct chat_arena {
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint64_t top;  // Bytes handed out by the bump allocator
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint64_t free_lists[ARENA_CLASSES];
+};
+
+_Static_assert((uint64_t)ARENA_MIN_BLOCK << (ARENA_CLASSES - 1) >= (uint64_t)CHAT_MAX_PAYLOAD + 1,
+               "ARENA_CLASSES too small for CHAT_MAX_PAYLOAD");
+// Bounds on the runtime sizes (room_config); the defaults must fit them
+#define ARENA_MIN_SIZE   (2 * ((uint64_t)CHAT_MAX_PAYLOAD + 1))
+#define ARENA_MAX_SIZE   ((uint64_t)ARENA_INDEX_MASK * ARENA_MIN_BLOCK)
+#define RING_MIN_SLOTS   16
+#define RING_MAX_SLOTS   (1u << 24)
+
+_Static_assert(CHAT_ARENA_SIZE >= ARENA_MIN_SIZE,
+               "CHAT_ARENA_SIZE must hold at least two maximum-size messages");
+_Static_assert(CHAT_ARENA_SIZE <= ARENA_MAX_SIZE,
+               "CHAT_ARENA_SIZE too large for arena block references");
+
+_Static_assert((CHAT_RING_CAPACITY & (CHAT_RING_CAPACITY - 1)) == 0 &&
+               CHAT_RING_CAPACITY >= RING_MIN_SLOTS && CHAT_RING_CAPACITY <= RING_MAX_SLOTS,
+               "CHAT_RING_CAPACITY must be a power of two within the ring bounds");
+
+// Participant states. A member is owned by its process: one whose pid has
+// died without leaving becomes ORPHANED, keeping its cursor (and so its
+// unread messages) until it is resumed or CHAT_RESUME_GRACE_SECONDS pass.
+#define PARTICIPANT_FREE     0
+#define PARTICIPANT_ACTIVE   1
+#define PARTICIPANT_ORPHANED 2
+
+// A room member. The cursor is the next sequence this member will read and
+// is only ever written by its owner, so it lives on its own cache line.
+// id interns the member's name for this membership: slots carry it, so a
+// reader recognizes its own messages with one integer compare, and it is
+// never reused by a later member even if the name or the slot is.
+struct chat_participant {
+    _Atomic uint32_t state;
+    pid_t pid;
+    uint32_t id;
+    char name[MAX_USERNAME_LEN];
+    uint64_t orphaned_at;  // CLOCK_MONOTONIC second it was orphaned
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint32_t cursor;
+    _Atomic uint64_t sent;      // Messages this member published
+    _Atomic uint64_t received;  // Messages from others this member displayed
+    _Atomic uint64_t latency_ns;  // Publish-to-delivery time of the last message it took
+    _Atomic uint64_t outbox_depth;    // Lines waiting in its outbox for ring space
+    _Atomic uint64_t outbox_drained;  // Lines that went out through the outbox
+};
+
+// Room-wide runtime counters, readable by chatstat without taking any lock.
+// All updates are relaxed atomics, and apart from the delivery histogram
+// they are off the per-message fast path; max_depth and latency_max_ns are
+// only written when they grow. latency_counts is a chat_histogram bucket
+// array of publish-to-delivery times, one entry per message per reader.
+struct chat_stats {
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint64_t queue_full;  // Publishes refused: ring full
+    _Atomic uint64_t arena_full;        // Publishes refused: no arena space
+    _Atomic uint64_t max_depth;         // Most messages ever pending in the ring
+    _Atomic uint64_t lock_acquires;     // Semaphore 0 acquisitions
+    _Atomic uint64_t lock_wait_ns;      // Total time spent waiting for semaphore 0
+    _Atomic uint64_t lock_wait_max_ns;  // Longest single wait for semaphore 0
+    _Atomic uint64_t bytes_logged;      // Log and journal bytes written by all members
+    _Atomic uint64_t latency_max_ns;    // Slowest delivery
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint64_t latency_counts[HIST_BUCKETS];
+};
+
+// Segment header. A member only uses a segment whose magic, layout version
+// and size match its own build; the creator stores magic last, so a segment
+// carrying it is fully initialized. generation counts membership recoveries
+// (orphaning, releasing or resuming a member) for chatstat.
+//
+// The ring and the arena are sized by the room's creator (room_config), so
+// the header also records where they are. Everyone else takes those sizes
+// from here; they are checked against the mapping before use and never
+// change afterwards. channel names the room ("" for the main one), so a
+// member can tell when two channel names hash to the same keys.
+#define ROOM_MAGIC          0x43484154u  // "CHAT"
+#define ROOM_LAYOUT_VERSION 6
+
+struct room_header {
+    _Atomic uint32_t magic;
+    uint32_t layout_version;
+    uint64_t layout_size;  // sizeof(struct shmseg) in the creating build
+    pid_t creator;
+    _Atomic uint32_t generation;
+    uint32_t ring_capacity;  // Slots, a power of two
+    uint32_t ring_mask;
+    uint64_t arena_size;
+    uint64_t arena_offset;   // Arena start, from the start of the segment
+    uint64_t segment_size;   // Bytes the layout needs (the mapping may be rounded up)
+    char channel[CHAT_CHANNEL_NAME_MAX];
 };
 
+// Shared segment for one chat room. The fixed part below is followed by
+// header.ring_capacity slots and then the arena, at header.arena_offset.
+//
+// All members publish into a single multi-producer broadcast ring: a sender
+// claims a sequence number by CAS on head, fills the slot and marks it
+// published. Every member reads the ring through its own cursor, so a reader
+// only touches messages that are new to it. Slots are reclaimed once every
+// member's cursor has passed them; tail caches the oldest cursor and is only
+// recomputed from the participant table when the ring looks full.
+//
+// Message bodies are variable-length and live in the arena; a slot only
+// carries the block reference and length. A body is freed when its slot is
+// reused, or earlier by a sender that ran out of arena space and sweeps
+// bodies every reader has already passed.
+//
+// published and tail double as futex words: idle readers sleep on
+// published, senders facing a full ring or arena sleep on tail. The waiter
+// counts let the other side skip the FUTEX_WAKE syscall when nobody is
+// asleep. Semaphore 0 only guards joining and leaving the participant table;
+// it is taken with SEM_UNDO, so a member killed while holding it releases it.
+//
+// Nothing is wiped when a member dies: its entry is orphaned and a restart
+// under the same name resumes from its cursor. The last live member out
+// only removes the room if no orphan is still waiting to be resumed.
 struct shmseg {
-    struct chat_message messages[10];  // Buffer for multiple messages
-    int message_count;
-    int current_message;
-    int last_message_id;
-    int system_ready;  // 0 = not ready, 1 = ready
+    struct room_header header;
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint32_t head;
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint32_t published;
+    _Atomic uint32_t data_waiters;
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint32_t tail;
+    _Atomic uint32_t space_waiters;
+    _Alignas(CHAT_CACHE_LINE) _Atomic uint32_t system_ready;  // 0 = not ready, 1 = ready (futex word)
+    uint32_t participant_count;  // Active and orphaned members; guarded by semaphore 0
+    uint32_t last_sender_id;     // Guarded by semaphore 0
+    uint64_t epoch;              // Creation time; high half of journal message IDs
+    _Atomic uint64_t last_recovery;  // CLOCK_MONOTONIC second of the last room_recover() scan
+    struct chat_participant participants[MAX_USERS];
+    struct chat_stats stats;
+    struct chat_arena arena;
+    _Alignas(CHAT_CACHE_LINE) struct chat_slot slots[];
 };
 
-// Semaphore helper functions
-void sem_wait(int semid, int semnum) {
-    struct sembuf sb = {semnum, -1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("sem_wait failed");
-        exit(1);
-    }
+static inline struct chat_slot* room_slot(struct shmseg* shm, uint32_t seq) {
+    return &shm->slots[seq & shm->header.ring_mask];
 }
 
-void sem_signal(int semid, int semnum) {
-    struct sembuf sb = {semnum, +1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("sem_signal failed");
-        exit(1);
-    }
+static inline uint64_t chat_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-// Logging functions
-void log_message(const char* user, const char* message) {
-    // FIX: Check log file size and rotate if too large
-    struct stat st;
-    if (stat(LOG_FILE, &st) == 0 && st.st_size > 1024 * 1024) { // 1MB limit
-        char old_log[64];
-        snprintf(old_log, sizeof(old_log), "%s.old", LOG_FILE);
-        rename(LOG_FILE, old_log);
-        log_system_event("Log file rotated due to size limit");
-    }
-    
-    FILE *log_file = fopen(LOG_FILE, "a");
-    if (log_file == NULL) {
-        perror("Failed to open log file");
-        return;
+// Raise a shared high-water mark
+static inline void stat_max(_Atomic uint64_t* counter, uint64_t value) {
+    uint64_t seen = atomic_load_explicit(counter, memory_order_relaxed);
+    while (value > seen &&
+           !atomic_compare_exchange_weak_explicit(counter, &seen, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
     }
-    
-    time_t now;
-    time(&now);
-    struct tm *tm_info = localtime(&now);
-    
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    fprintf(log_file, "[%s] %s: %s\n", timestamp, user, message);
-    fclose(log_file);
 }
 
-// Check if message is an exit command
-int is_exit_command(const char* message) {
-    char lower[MAX_MESSAGE_LEN];
-    strncpy(lower, message, MAX_MESSAGE_LEN);
-    for (int i = 0; lower[i]; i++) {
-        lower[i] = tolower(lower[i]);
-    }
-    return (strcmp(lower, "exit") == 0 || strcmp(lower, "bye") == 0 || 
-            strcmp(lower, "quit") == 0 || strcmp(lower, "q") == 0);
+static inline void stat_add(_Atomic uint64_t* counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
 }
 
-// Display welcome message
-void display_welcome(const char* username, const char* color) {
-    printf("\n%s%s╔══════════════════════════════════════════════════════════════╗%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("%s%s║                    CHAT SYSTEM v%s                         ║%s\n", COLOR_BOLD, color, VERSION, COLOR_RESET);
-    printf("%s%s║                                                              ║%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("%s%s║  Welcome %s%-20s%s!                                    ║%s\n", COLOR_BOLD, color, COLOR_WHITE, username, color, COLOR_RESET);
-    printf("%s%s║                                                              ║%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("%s%s║  Commands: exit, bye, quit, q                              ║%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("%s%s║  Type your messages below...                               ║%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("%s%s╚══════════════════════════════════════════════════════════════╝%s\n", COLOR_BOLD, color, COLOR_RESET);
-    printf("\n");
-}
+// Futex and semaphore calls made by this process, so benchmarks can report
+// syscalls per message
+extern _Atomic uint64_t chat_syscalls;
 
-// Display typing indicator
-void display_typing_indicator(const char* username, const char* color) {
-    printf("%s%s%s is typing...%s\r", COLOR_DIM, color, username, COLOR_RESET);
-    fflush(stdout);
-    usleep(500000);  // 0.5 second delay
-    printf("\r%*s\r", 50, "");  // Clear the line
-    fflush(stdout);
-}
+/* ---- Segment backends (chat_segment.c) ---- */
 
-// Display message with proper formatting
-void display_message(const char* sender, const char* message, const char* color, int is_own) {
-    time_t now;
-    time(&now);
-    struct tm *tm_info = localtime(&now);
-    char timestamp[16];
-    strftime(timestamp, sizeof(timestamp), "%H:%M", tm_info);
-    
-    if (is_own) {
-        printf("%s[%s] %sYou: %s%s%s\n", COLOR_DIM, timestamp, color, COLOR_RESET, message, COLOR_RESET);
-    } else {
-        printf("%s[%s] %s%s: %s%s%s\n", COLOR_DIM, timestamp, color, sender, COLOR_RESET, message, COLOR_RESET);
-    }
-}
+// Where a room's segment lives. SysV segments are found by SHM_KEY and
+// POSIX ones by the name /chat-<SHM_KEY> (a file under /dev/shm). memfd
+// segments have no name, so only forked children can share them; chatbench
+// uses them for its private rooms.
+//
+// Every named channel is a room of its own, with its own segment and
+// semaphore: its keys are SHM_KEY and SEM_KEY offset by a hash of the name
+// (room_channel_key()) and its POSIX name is /chat-<SHM_KEY>.<name>. Rooms
+// share nothing, so traffic in one channel never contends with another's.
+// The main room is the channel "".
+#define ROOM_SHM_SYSV  0
+#define ROOM_SHM_POSIX 1
+#define ROOM_SHM_MEMFD 2
 
-// Check and clean existing resources
-void check_existing_resources() {
-    // Check for existing shared memory
-    int existing_shmid = shmget(SHM_KEY, 0, 0);
-    if (existing_shmid != -1) {
-        printf("%sFound existing shared memory (ID: %d), removing...%s\n", INFO_COLOR, existing_shmid, COLOR_RESET);
-        shmctl(existing_shmid, IPC_RMID, NULL);
-    }
-    
-    // Check for existing semaphores
-    int existing_semid = semget(SEM_KEY, 0, 0);
-    if (existing_semid != -1) {
-        printf("%sFound existing semaphore set (ID: %d), removing...%s\n", INFO_COLOR, existing_semid, COLOR_RESET);
-        semctl(existing_semid, 0, IPC_RMID);
-    }
-}
+// How segments are made and mapped, set from the command line before
+// attaching (room_config_parse()). The sizes only apply to a room being
+// created: joining members use the creator's.
+struct room_config {
+    int backend;
+    uint32_t ring_capacity;
+    uint64_t arena_size;
+    int hugepages;    // hugetlb pages where reserved, else transparent huge pages
+    int lock_memory;  // mlock() the mapping, faulting it all in up front
+};
 
-void sanitize_input(char* input) {
-    // Remove control characters
-    for (int i = 0; input[i]; i++) {
-        if (input[i] < 32 && input[i] != '\n' && input[i] != '\t') {
-            input[i] = ' ';
-        }
-    }
-}
+extern struct room_config room_config;
 
-// Add function to clear processed messages
-void clear_processed_messages(struct shmseg* shm, int up_to_id) {
-    int write_index = 0;
-    for (int i = 0; i < shm->message_count; i++) {
-        if (shm->messages[i].message_id > up_to_id) {
-            shm->messages[write_index++] = shm->messages[i];
-        }
-    }
-    shm->message_count = write_index;
-}
+// Huge page backing a mapping got
+#define ROOM_PAGES_NORMAL  0
+#define ROOM_PAGES_THP     1  // madvise(MADV_HUGEPAGE)
+#define ROOM_PAGES_HUGETLB 2
 
-// Initialize chat session with user identity and default state
-void chat_session_init(ChatSession* session, const char* username, const char* color) {
-    memset(session, 0, sizeof(ChatSession));
-    session->username = username;
-    session->color = color;
-    session->last_seen_id = 0;
-    session->shmid = -1;
-    session->semid = -1;
-    session->shm = NULL;
-}
+// One process's mapping of a segment
+struct room_segment {
+    int backend;
+    int shmid;         // SysV ID, or -1
+    int fd;            // POSIX or memfd descriptor, or -1
+    size_t size;       // Bytes mapped
+    int pages;         // ROOM_PAGES_*
+    int locked;        // mlock() succeeded
+    char name[48];     // POSIX name while it is linked, else empty
+    char channel[CHAT_CHANNEL_NAME_MAX];
+    struct shmseg* shm;
+};
 
-//Clean up session resources: detach shared memory and reset state
-void chat_session_cleanup(ChatSession* session) {
-    if (session->shm != NULL) {
-        shmdt(session->shm);
-        session->shm = NULL;
-    }
-    // Note: IPC removal is handled by cleanup_resources
-    session->shmid = -1;
-    session->semid = -1;
-}
+int room_config_parse(int* argc, char** argv);
+void room_config_usage(void);
+const char* room_backend_name(int backend);
+size_t room_layout_size(uint32_t ring_capacity, uint64_t arena_size);
+void room_format(struct shmseg* shm, uint32_t ring_capacity, uint64_t arena_size);
+int room_layout_valid(const struct shmseg* shm, size_t mapped);
+int room_channel_valid(const char* name);
+key_t room_channel_key(key_t base, const char* channel);
+int segment_create(struct room_segment* seg, const char* channel, int shared);
+int segment_open(struct room_segment* seg, const char* channel, int readonly);
+int segment_sole_user(struct room_segment* seg);
+void segment_detach(struct room_segment* seg);
+void segment_remove(struct room_segment* seg);
 
-//brief Initialize Unicode and locale support for international text
- 
-void setup_unicode(void) {
-    if (setlocale(LC_ALL, "en_US.UTF-8") == NULL) {
-        // Fallback if UTF-8 locale is not available
-        setlocale(LC_ALL, "C");
-        printf("%sWarning: UTF-8 locale not available, using basic locale%s\n", 
-               COLOR_YELLOW, COLOR_RESET);
-    }
-}
+/* ---- Room transport (chat_room.c) ---- */
 
+int futex_wait(_Atomic uint32_t* addr, uint32_t expected, const struct timespec* timeout);
+void futex_wake(_Atomic uint32_t* addr, int count);
+void sem_wait(int semid, int semnum);
+void sem_signal(int semid, int semnum);
 
-//Create a new message buffer with specified capacity
-MessageBuffer* buffer_create(size_t capacity) {
-    MessageBuffer* buffer = malloc(sizeof(MessageBuffer));
-    if (!buffer) return NULL;
-    
-    buffer->messages = malloc(sizeof(struct chat_message) * capacity);
-    if (!buffer->messages) {
-        free(buffer);
-        return NULL;
-    }
-    
-    buffer->capacity = capacity;
-    buffer->count = 0;
-    buffer->head = 0;
-    buffer->tail = 0;
-    return buffer;
-}
+uint32_t room_reclaim(struct shmseg* shm);
+size_t room_publish_batch(struct shmseg* shm, const struct chat_participant* from,
+                          const struct chat_outgoing* msgs, size_t count, uint32_t* first_id);
+uint32_t room_publish(struct shmseg* shm, const struct chat_participant* from, const char* content,
+                      size_t length, int type);
+int room_read(struct shmseg* shm, struct chat_participant* me, struct chat_message* msg);
+void room_mark_read(struct shmseg* shm, const struct chat_participant* me, const struct chat_message* msg);
+void room_advance(struct shmseg* shm, struct chat_participant* me);
+int room_message_acks(struct shmseg* shm, uint32_t id, uint64_t* delivered, uint64_t* read);
+uint64_t room_latency_percentile(struct shmseg* shm, double percentile, uint64_t* total);
+int room_wait_published(struct shmseg* shm, uint32_t seen, const struct timespec* timeout);
+int room_wait_writable(struct shmseg* shm, uint32_t seen_tail, const struct timespec* timeout);
+void room_lock_at(struct shmseg* shm, int semid, const char* func, int line);
+void room_unlock_at(int semid, const char* func, int line);
+// Semaphore 0, traced under the caller's name and line
+#define room_lock(shm, semid) room_lock_at((shm), (semid), __func__, __LINE__)
+#define room_unlock(semid)    room_unlock_at((semid), __func__, __LINE__)
+int room_recover(struct shmseg* shm, int semid);
+uint32_t room_new_sender_id(struct shmseg* shm, int semid);
+int room_join(struct shmseg* shm, int semid, const char* name, int* resumed);
+uint32_t room_leave(struct shmseg* shm, int semid, int index);
+int room_attach(struct room_segment* seg, const char* channel, int* semid_out);
+void cleanup_resources(struct room_segment* seg, int semid);
 
-//Destroy message buffer and free all resources
-void buffer_destroy(MessageBuffer* buffer) {
-    if (buffer) {
-        free(buffer->messages);
-        free(buffer);
-    }
-}
+// Notifier thread: sleeps on the room's publish futex and turns every
+// publish into readiness on an eventfd, so an event loop can poll() shared
+// memory alongside its other descriptors.
+struct chat_notifier {
+    struct shmseg* shm;
+    uint32_t seen;  // published when it was started
+    int efd;
+    pthread_t thread;
+    _Atomic int stop;
+};
 
-//Push a message to the buffer (circular)
-int buffer_push(MessageBuffer* buffer, const struct chat_message* msg) {
-    if (!buffer || !msg || buffer->count >= buffer->capacity) {
-        return 0; // Failure
-    }
-    
-    buffer->messages[buffer->tail] = *msg;
-    buffer->tail = (buffer->tail + 1) % buffer->capacity;
-    buffer->count++;
-    return 1; // Success
-}
+int chat_notifier_start(struct chat_notifier* notifier, struct shmseg* shm);
+void chat_notifier_stop(struct chat_notifier* notifier);
 
-//Pop a message from the buffer (circular)
-int buffer_pop(MessageBuffer* buffer, struct chat_message* msg) {
-    if (!buffer || !msg || buffer->count == 0) {
-        return 0; // Failure
-    }
-    
-    *msg = buffer->messages[buffer->head];
-    buffer->head = (buffer->head + 1) % buffer->capacity;
-    buffer->count--;
-    return 1; // Success
-}
+/* ---- Logging (chat_log.c) ---- */
+
+void log_system_event(const char* message);
+void log_message(const char* user, const char* message);
+void journal_append(uint64_t message_id, int type, const char* sender, const char* content,
+                    size_t content_len);
+uint64_t chat_logger_bytes_logged(void);
+void show_journal_history(size_t count);
+void search_log_history(const char* text);
+size_t search_history(const char* query, size_t limit,
+                      void (*on_match)(const struct journal_record* rec, void* arg), void* arg);
+
+/* ---- Session API (chat_session.c) ---- */
+
+// One member's connection to the room. This is the library's entry point
+// for bots and tools: open, send, receive with a timeout, poll, close. None
+// of it prints message traffic or touches the terminal.
+typedef struct {
+    struct room_segment segment;
+    int semid;
+    struct shmseg* shm;
+    char username[MAX_USERNAME_LEN];
+    const char* color;
+    int index;                       // Participant slot, -1 while not joined
+    struct chat_participant* me;
+    int resumed;                     // Took over an orphaned entry under this name
+    int pending;                     // Last chat_recv() message not yet consumed
+    struct chat_notifier notifier;   // Started by the first chat_poll_fd()
+    int notifier_running;
+} ChatSession;
+
+void chat_session_init(ChatSession* session, const char* username, const char* color);
+void chat_session_cleanup(ChatSession* session);
+int chat_open(ChatSession* session, const char* username);
+int chat_open_channel(ChatSession* session, const char* username, const char* channel);
+uint32_t chat_send(ChatSession* session, const char* text, size_t length, int type, int timeout_ms);
+int chat_recv(ChatSession* session, struct chat_message* msg, int timeout_ms);
+int chat_poll_fd(ChatSession* session);
+void chat_close(ChatSession* session);
+
+MessageBuffer* buffer_create(size_t capacity);
+void buffer_destroy(MessageBuffer* buffer);
+int buffer_push(MessageBuffer* buffer, const struct chat_message* msg);
+int buffer_pop(MessageBuffer* buffer, struct chat_message* msg);
+const struct chat_message* buffer_peek(const MessageBuffer* buffer, size_t index);
+void buffer_drop(MessageBuffer* buffer, size_t count);
+
+/* ---- Terminal output (chat_render.c) ---- */
+
+// A reusable output buffer for one descriptor. Everything shown during one
+// pass of the event loop is appended here and written with a single
+// render_flush().
+struct chat_render {
+    int fd;
+    int tty;                // fd is a terminal: cursor control allowed
+    int colors;             // Emit ANSI colors (a terminal, and NO_COLOR unset)
+    char* buf;
+    size_t len;
+    size_t cap;
+    time_t stamp_time;      // Second the cached timestamp was formatted in
+    char stamp[8];          // "HH:MM"
+    uint64_t typing_until;  // CLOCK_MONOTONIC ns the typing indicator expires, 0 = none
+};
+
+void render_init(struct chat_render* r, int fd);
+void render_free(struct chat_render* r);
+struct chat_render* render_stdout(void);
+void render_append(struct chat_render* r, const char* text, size_t length);
+void render_text(struct chat_render* r, const char* text, size_t length);
+void render_str(struct chat_render* r, const char* text);
+void render_color(struct chat_render* r, const char* code);
+void render_vformat(struct chat_render* r, const char* fmt, va_list ap);
+void render_format(struct chat_render* r, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void render_line(struct chat_render* r, const char* color, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void render_message(struct chat_render* r, const char* sender, const char* text, size_t length,
+                    const char* color, int is_own);
+void render_clear_line(struct chat_render* r);
+void render_typing(struct chat_render* r, const char* name, const char* color, int duration_ms);
+int render_timeout(const struct chat_render* r);
+int render_tick(struct chat_render* r);
+int render_flush(struct chat_render* r);
+
+/* ---- Interactive client (chat_client.c) ---- */
+
+int is_exit_command(const char* message);
+void display_welcome(const char* username, const char* color);
+void display_typing_indicator(const char* username, const char* color);
+void display_message(const char* sender, const char* message, const char* color, int is_own);
+void sanitize_input(char* input);
+const char* user_color(const char* name);
+void setup_unicode(void);
+
+// One room the client is in: the main room, or a channel it joined with
+// /join. Each has its own session, notifier and outbox, so a channel whose
+// ring is full holds up only the lines typed into it.
+struct chat_channel {
+    char name[CHAT_CHANNEL_NAME_MAX];  // "" for the main room
+    ChatSession* session;
+    int efd;                           // The session's poll fd, -1 until the event loop runs
+    uint32_t last_sent_id;             // Our latest message, for /stats acknowledgements
+    MessageBuffer* outbox;             // Lines waiting for ring space, oldest first
+    uint64_t outbox_since_ns;          // When the outbox last went from empty to backed up
+    uint64_t outbox_episode_drained;   // Lines drained since then
+};
+
+// One room member, as seen by the event loop
+struct chat_client {
+    const char* name;
+    const char* color;
+    ChatSession* session;                  // Our membership in the main room
+    volatile sig_atomic_t* interrupted;    // Set by the signal handler
+    void (*on_sent)(const char* message);  // Optional hook after each send
+    void (*on_history)(void);              // Optional: what /history shows
+    struct chat_channel channels[CHAT_MAX_CHANNELS];  // [0] is the main room, set up on first use
+    int channel_count;
+    int active;                            // Channel typed lines go to
+    uint64_t logged_reported;              // Our logger bytes already added to the room stats
+    int pipe_mode;                         // stdin is a script: no prompt, no echo of our lines
+};
+
+// Complete lines waiting to be sent with one chat_send_batch() call. The
+// lines sit back to back in data, each NUL-terminated.
+struct line_batch {
+    char* data;
+    size_t len;
+    size_t cap;
+    size_t offsets[CHAT_SEND_BATCH_MAX];
+    size_t count;
+};
+
+// Accumulates stdin bytes into lines, growing up to CHAT_MAX_PAYLOAD;
+// oversized lines are dropped whole
+struct line_reader {
+    char* line;
+    size_t len;
+    size_t cap;
+    int overflow;
+    struct line_batch batch;
+};
+
+#define CHAT_LEFT 1  // Returned by handlers when the conversation is over
+
+size_t chat_send_batch(struct chat_client* client, const struct chat_outgoing* msgs, size_t count);
+int chat_client_send(struct chat_client* client, const char* input, int type);
+int chat_client_handle_line(struct chat_client* client, const char* input);
+void chat_client_run(struct chat_client* client);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CHAT_HISTOGRAM_H
+#define CHAT_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// HDR-style latency histogram.
+//
+// Values below 2 * HIST_SUB_BUCKETS get a bucket each; above that every
+// power-of-two range is split into HIST_SUB_BUCKETS linear buckets, so any
+// recorded value is reported within 1/64 (~1.6%) of its true size while
+// nanosecond to minute-long latencies fit in a fixed 32KB table.
+
+#define HIST_SUB_BITS     6
+#define HIST_SUB_BUCKETS  (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS      (HIST_SUB_BUCKETS * 64)
+
+struct chat_histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+static inline int hist_bucket(uint64_t value) {
+    if (value < 2 * HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKETS + (int)((value >> shift) - HIST_SUB_BUCKETS);
+}
+
+// Highest value that maps to the bucket, as HDR histograms report it
+static inline uint64_t hist_bucket_value(int bucket) {
+    if (bucket < 2 * HIST_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / HIST_SUB_BUCKETS - 1;
+    uint64_t mantissa = (uint64_t)(bucket % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void hist_init(struct chat_histogram* hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+static inline void hist_record(struct chat_histogram* hist, uint64_t value) {
+    hist->counts[hist_bucket(value)]++;
+    hist->total++;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+static inline void hist_merge(struct chat_histogram* into, const struct chat_histogram* from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if (from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+// Value at the given percentile (0-100) over a raw bucket array
+static inline uint64_t hist_percentile_counts(const uint64_t* counts, uint64_t total, double percentile) {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return hist_bucket_value(i);
+        }
+    }
+    return hist_bucket_value(HIST_BUCKETS - 1);
+}
+
+static inline uint64_t hist_percentile(const struct chat_histogram* hist, double percentile) {
+    uint64_t value = hist_percentile_counts(hist->counts, hist->total, percentile);
+    return value > hist->max ? hist->max : value;
+}
+
+#endif
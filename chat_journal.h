@@ -0,0 +1,217 @@
+#ifndef CHAT_JOURNAL_H
+#define CHAT_JOURNAL_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Binary message journal.
+//
+// chat_history.jnl is an append-only file of length-prefixed records. Each
+// record also ends with a copy of its length, so the file can be walked
+// backwards from the end: printing the last N messages costs O(N) no matter
+// how large the journal is. chat_history.jnl.idx is a sparse index with one
+// {message_id, offset} entry roughly every CHAT_JOURNAL_INDEX_STRIDE bytes,
+// used to seek to a message ID and to resynchronize after a torn write.
+// Readers mmap both files and read records in place without copying.
+
+#define JOURNAL_FILE       "chat_history.jnl"
+#define JOURNAL_INDEX_FILE "chat_history.jnl.idx"
+#define JOURNAL_MAGIC      0x4C4E524Au  // "JRNL"
+
+struct journal_record {
+    uint32_t magic;
+    uint32_t length;        // Whole record: header, payload, padding, trailer
+    uint64_t message_id;    // Room epoch << 32 | ring sequence
+    int64_t timestamp;      // Wall-clock seconds when the message was sent
+    uint16_t type;          // MSG_TYPE_*
+    uint16_t sender_len;
+    uint32_t content_len;
+    // char sender[sender_len], char content[content_len],
+    // zero padding to 4 bytes, uint32_t length
+};
+
+struct journal_index_entry {
+    uint64_t message_id;
+    uint64_t offset;
+};
+
+// Size of a record with the given payload, including padding and trailer
+static inline uint32_t journal_record_size(size_t sender_len, size_t content_len) {
+    size_t body = sizeof(struct journal_record) + sender_len + content_len;
+    return (uint32_t)(((body + 3) & ~(size_t)3) + sizeof(uint32_t));
+}
+
+// Serialize one record into out, which must hold journal_record_size()
+// bytes. Returns the number of bytes written.
+static inline uint32_t journal_encode(char* out, uint64_t message_id, int64_t timestamp, int type,
+                                      const char* sender, const char* content, size_t content_len) {
+    size_t sender_len = strlen(sender);
+    uint32_t length = journal_record_size(sender_len, content_len);
+    struct journal_record header = {
+        .magic = JOURNAL_MAGIC,
+        .length = length,
+        .message_id = message_id,
+        .timestamp = timestamp,
+        .type = (uint16_t)type,
+        .sender_len = (uint16_t)sender_len,
+        .content_len = (uint32_t)content_len,
+    };
+
+    memset(out, 0, length);
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), sender, sender_len);
+    memcpy(out + sizeof(header) + sender_len, content, content_len);
+    memcpy(out + length - sizeof(uint32_t), &length, sizeof(uint32_t));
+    return length;
+}
+
+// A read-only, memory-mapped view of the journal and its index
+struct journal_view {
+    const char* base;
+    size_t size;
+    const struct journal_index_entry* index;
+    size_t index_count;
+};
+
+static inline const char* journal_sender(const struct journal_record* rec) {
+    return (const char*)(rec + 1);
+}
+
+static inline const char* journal_content(const struct journal_record* rec) {
+    return (const char*)(rec + 1) + rec->sender_len;
+}
+
+// Return the record starting at offset, or NULL if there is no complete,
+// well-formed record there
+static inline const struct journal_record* journal_record_at(const struct journal_view* view,
+                                                             uint64_t offset) {
+    if (offset + sizeof(struct journal_record) + sizeof(uint32_t) > view->size || offset % 4 != 0) {
+        return NULL;
+    }
+    const struct journal_record* rec = (const struct journal_record*)(view->base + offset);
+    if (rec->magic != JOURNAL_MAGIC || rec->length > view->size - offset ||
+        rec->length != journal_record_size(rec->sender_len, rec->content_len)) {
+        return NULL;
+    }
+    uint32_t trailer;
+    memcpy(&trailer, view->base + offset + rec->length - sizeof(uint32_t), sizeof(trailer));
+    return trailer == rec->length ? rec : NULL;
+}
+
+static inline void* journal_map(const char* path, size_t* size) {
+    struct stat st;
+    void* base = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    *size = 0;
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            base = NULL;
+        } else {
+            *size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+    return base;
+}
+
+// Map the journal and its index. Returns 0 if there is no journal yet.
+static inline int journal_open(struct journal_view* view, const char* path, const char* index_path) {
+    size_t index_size;
+
+    memset(view, 0, sizeof(*view));
+    view->base = journal_map(path, &view->size);
+    if (!view->base) {
+        return 0;
+    }
+    view->index = journal_map(index_path, &index_size);
+    view->index_count = index_size / sizeof(struct journal_index_entry);
+    return 1;
+}
+
+static inline void journal_close(struct journal_view* view) {
+    if (view->base) {
+        munmap((void*)view->base, view->size);
+    }
+    if (view->index) {
+        munmap((void*)view->index, view->index_count * sizeof(struct journal_index_entry));
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+// End offset of the last complete record. Normally that is the file size;
+// after a torn write we resynchronize from the nearest index entry.
+static inline uint64_t journal_valid_end(const struct journal_view* view) {
+    uint32_t trailer;
+    if (view->size >= sizeof(uint32_t)) {
+        memcpy(&trailer, view->base + view->size - sizeof(uint32_t), sizeof(trailer));
+        if (trailer <= view->size && journal_record_at(view, view->size - trailer)) {
+            return view->size;
+        }
+    }
+
+    uint64_t offset = 0;
+    for (size_t i = view->index_count; i-- > 0; ) {
+        if (view->index[i].offset < view->size && journal_record_at(view, view->index[i].offset)) {
+            offset = view->index[i].offset;
+            break;
+        }
+    }
+    const struct journal_record* rec;
+    while ((rec = journal_record_at(view, offset)) != NULL) {
+        offset += rec->length;
+    }
+    return offset;
+}
+
+// Offset of the record `count` records before end (or 0 if the journal is
+// shorter than that), found by walking the trailers backwards
+static inline uint64_t journal_tail(const struct journal_view* view, uint64_t end, size_t count) {
+    uint64_t offset = end;
+    while (count-- > 0 && offset > 0) {
+        uint32_t length;
+        memcpy(&length, view->base + offset - sizeof(uint32_t), sizeof(length));
+        if (length > offset || !journal_record_at(view, offset - length)) {
+            break;
+        }
+        offset -= length;
+    }
+    return offset;
+}
+
+// Offset of the first record with message_id >= id. The index narrows the
+// search to one stride; the rest is a short forward scan.
+static inline uint64_t journal_seek(const struct journal_view* view, uint64_t id) {
+    size_t lo = 0, hi = view->index_count;
+    uint64_t offset = 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (view->index[mid].message_id <= id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && journal_record_at(view, view->index[lo - 1].offset)) {
+        offset = view->index[lo - 1].offset;
+    }
+
+    const struct journal_record* rec;
+    while ((rec = journal_record_at(view, offset)) != NULL && rec->message_id < id) {
+        offset += rec->length;
+    }
+    return offset;
+}
+
+#endif
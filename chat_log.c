@@ -0,0 +1,963 @@
+/*
+ * chat_log.c
+ * OS Chat System - logging
+ * The background logger and archiver threads behind log_message(),
+ * log_system_event() and journal_append(), plus the history readers.
+ */
+
+#include "chat_common.h"
+
+// Background logger.
+//
+// log_message and log_system_event only format a line into an in-memory
+// buffer; a writer thread swaps the buffers out and writes each file with a
+// single write() per batch, so no file I/O happens on the message path.
+// Rotation is checked once per batch rather than per message: one stat()
+// refreshes the shared file size and notices when another member already
+// rotated the file. Rotated generations are handed to a second thread that
+// compresses and prunes them (chat_archive.h). If a buffer fills up before
+// the writer drains it the record is dropped and counted rather than
+// blocking the caller. The binary journal (chat_journal.h) is written the
+// same way.
+struct log_sink {
+    const char* path;
+    int fd;
+    uint64_t bytes;          // Size of the current file as of the last batch
+    uint64_t rotate_bytes;   // 0 = never rotate
+    time_t rotate_seconds;   // 0 = no time-based rotation
+    ino_t ino;               // Which file fd refers to, to notice rotations
+    time_t started;          // Timestamp of the file's first line
+    char* fill;              // Buffer producers append to
+    size_t fill_len;
+    size_t fill_cap;
+    char* spare;             // Buffer the writer thread drains
+    size_t spare_cap;
+    uint64_t fill_first_id;  // Journal only: first message ID in each buffer
+    uint64_t spare_first_id;
+};
+
+struct chat_logger {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    int stop;
+    int writer_idle;
+    struct log_sink sinks[LOG_SINK_COUNT];
+    int index_fd;            // Sparse journal index
+    uint64_t last_indexed;   // Journal offset of the last index entry
+    time_t stamp_time;       // Timestamp string is reformatted once per second
+    char stamp[32];
+    uint64_t dropped;
+    _Atomic uint64_t bytes_logged;
+    pthread_cond_t archive_wake;   // Compression thread, started on first rotation
+    pthread_t archiver;
+    int archiver_running;
+    int archive_pending;
+    int archive_stop;
+    pthread_cond_t index_wake;     // Search indexer, started with the writer
+    pthread_t indexer;
+    int indexer_running;
+    int index_pending;
+    int index_stop;
+    _Atomic uint64_t index_due;    // Journal size at which the indexer is next woken
+};
+
+static struct chat_logger chat_log = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .archive_wake = PTHREAD_COND_INITIALIZER,
+    .index_wake = PTHREAD_COND_INITIALIZER,
+    .sinks = {
+        [LOG_SINK_HISTORY] = {.path = LOG_FILE, .fd = -1, .rotate_bytes = CHAT_LOG_ROTATE_BYTES,
+                              .rotate_seconds = CHAT_LOG_ROTATE_SECONDS},
+        [LOG_SINK_SYSTEM] = {.path = SYSTEM_LOG_FILE, .fd = -1},
+        [LOG_SINK_JOURNAL] = {.path = JOURNAL_FILE, .fd = -1},
+    },
+    .index_fd = -1,
+};
+static pthread_once_t chat_log_once = PTHREAD_ONCE_INIT;
+
+// When the file's first line was written, from its "[YYYY-mm-dd HH:MM:SS]"
+// prefix, so every member agrees on the file's age
+static time_t log_sink_started(const char* path, time_t fallback) {
+    char head[32];
+    struct tm tm_info;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return fallback;
+    }
+    ssize_t n = read(fd, head, sizeof(head) - 1);
+    close(fd);
+    if (n <= 0) {
+        return fallback;
+    }
+    head[n] = '\0';
+    memset(&tm_info, 0, sizeof(tm_info));
+    if (sscanf(head, "[%d-%d-%d %d:%d:%d]", &tm_info.tm_year, &tm_info.tm_mon, &tm_info.tm_mday,
+               &tm_info.tm_hour, &tm_info.tm_min, &tm_info.tm_sec) != 6) {
+        return fallback;
+    }
+    tm_info.tm_year -= 1900;
+    tm_info.tm_mon -= 1;
+    tm_info.tm_isdst = -1;
+    time_t started = mktime(&tm_info);
+    return started == (time_t)-1 ? fallback : started;
+}
+
+static void log_sink_open(struct log_sink* sink) {
+    struct stat st;
+    sink->fd = open(sink->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (sink->fd == -1) {
+        perror("Failed to open log file");
+        return;
+    }
+    if (fstat(sink->fd, &st) == 0) {
+        sink->bytes = (uint64_t)st.st_size;
+        sink->ino = st.st_ino;
+    } else {
+        sink->bytes = 0;
+        sink->ino = 0;
+    }
+    if (sink->rotate_seconds) {
+        sink->started = log_sink_started(sink->path, time(NULL));
+    }
+}
+
+// Wake (starting it if needed) the thread that compresses rotated
+// generations. Called from the writer thread.
+static void chat_archiver_kick(void);
+
+static void log_sink_rotate(struct log_sink* sink, const char* reason) {
+    struct stat st;
+    uint32_t generation = 0;
+
+    // Members rotate the same file: whoever gets the lock second finds the
+    // path already pointing at a fresh file and just reopens it
+    if (flock(sink->fd, LOCK_EX) == 0) {
+        if (stat(sink->path, &st) == 0 && st.st_ino == sink->ino) {
+            generation = archive_rotate(sink->path);
+        }
+        flock(sink->fd, LOCK_UN);
+    }
+    close(sink->fd);
+    log_sink_open(sink);
+
+    if (generation) {
+        char event[128];
+        snprintf(event, sizeof(event), "Log file rotated to %s.%u due to %s", sink->path, generation, reason);
+        log_system_event(event);
+        chat_archiver_kick();
+    }
+}
+
+// Once per batch: pick up the shared file size and follow a rotation done
+// by another member, then rotate ourselves if the file is due
+static void log_sink_check_rotation(struct log_sink* sink, size_t len) {
+    struct stat st;
+    if (stat(sink->path, &st) != 0 || st.st_ino != sink->ino) {
+        close(sink->fd);
+        log_sink_open(sink);
+        if (sink->fd == -1) {
+            return;
+        }
+    } else {
+        sink->bytes = (uint64_t)st.st_size;
+    }
+
+    time_t now = time(NULL);
+    if (sink->bytes == 0) {
+        sink->started = now;  // We are about to write the first line
+    } else if (sink->rotate_bytes && sink->bytes + len > sink->rotate_bytes) {
+        log_sink_rotate(sink, "size limit");
+    } else if (sink->rotate_seconds && now - sink->started >= sink->rotate_seconds) {
+        log_sink_rotate(sink, "age limit");
+    }
+}
+
+static void log_sink_write(struct log_sink* sink, const char* data, size_t len) {
+    if (sink->fd == -1) {
+        return;
+    }
+    if (sink->rotate_bytes || sink->rotate_seconds) {
+        log_sink_check_rotation(sink, len);
+        if (sink->fd == -1) {
+            return;
+        }
+    }
+    while (len > 0) {
+        ssize_t n = write(sink->fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write log file");
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+        sink->bytes += (uint64_t)n;
+        atomic_fetch_add_explicit(&chat_log.bytes_logged, (uint64_t)n, memory_order_relaxed);
+    }
+}
+
+static void chat_indexer_kick(void);
+
+// Other processes append to the journal too, so ask the kernel where our
+// batch landed and add an index entry once per CHAT_JOURNAL_INDEX_STRIDE.
+// The search indexer is woken once another segment's worth has piled up.
+static void journal_index_batch(struct log_sink* sink, size_t len) {
+    off_t end = lseek(sink->fd, 0, SEEK_CUR);
+    if (end != -1 && (uint64_t)end >= chat_log.index_due) {
+        chat_indexer_kick();
+    }
+    if (end == -1 || chat_log.index_fd == -1) {
+        return;
+    }
+    uint64_t start = (uint64_t)end - len;
+    if (chat_log.last_indexed != 0 && start - chat_log.last_indexed < CHAT_JOURNAL_INDEX_STRIDE) {
+        return;
+    }
+    struct journal_index_entry entry = {sink->spare_first_id, start};
+    if (write(chat_log.index_fd, &entry, sizeof(entry)) == sizeof(entry)) {
+        // Never 0 once written, so the first batch always gets an entry
+        chat_log.last_indexed = start ? start : 1;
+    }
+}
+
+// Called with the logger lock held
+static int chat_logger_empty(void) {
+    for (int i = 0; i < LOG_SINK_COUNT; i++) {
+        if (chat_log.sinks[i].fill_len > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void* chat_logger_main(void* arg) {
+    (void)arg;
+    struct timespec last_sync;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+
+    pthread_mutex_lock(&chat_log.lock);
+    while (1) {
+        while (!chat_log.stop && chat_logger_empty()) {
+            chat_log.writer_idle = 1;
+            pthread_cond_wait(&chat_log.wake, &chat_log.lock);
+            chat_log.writer_idle = 0;
+        }
+
+        // Linger briefly so a burst of messages goes out as one batch
+        if (!chat_log.stop) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)CHAT_LOG_FLUSH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            while (!chat_log.stop &&
+                   pthread_cond_timedwait(&chat_log.wake, &chat_log.lock, &deadline) != ETIMEDOUT) {
+            }
+        }
+
+        size_t lens[LOG_SINK_COUNT];
+        for (int i = 0; i < LOG_SINK_COUNT; i++) {
+            struct log_sink* sink = &chat_log.sinks[i];
+            char* full = sink->fill;
+            size_t full_cap = sink->fill_cap;
+            sink->fill = sink->spare;
+            sink->fill_cap = sink->spare_cap;
+            sink->spare = full;
+            sink->spare_cap = full_cap;
+            sink->spare_first_id = sink->fill_first_id;
+            lens[i] = sink->fill_len;
+            sink->fill_len = 0;
+        }
+        int stopping = chat_log.stop;
+        pthread_mutex_unlock(&chat_log.lock);
+
+        int wrote = 0;
+        for (int i = 0; i < LOG_SINK_COUNT; i++) {
+            if (lens[i] > 0) {
+                log_sink_write(&chat_log.sinks[i], chat_log.sinks[i].spare, lens[i]);
+                wrote = 1;
+            }
+        }
+        if (lens[LOG_SINK_JOURNAL] > 0 && chat_log.sinks[LOG_SINK_JOURNAL].fd != -1) {
+            journal_index_batch(&chat_log.sinks[LOG_SINK_JOURNAL], lens[LOG_SINK_JOURNAL]);
+        }
+
+        if (wrote && CHAT_LOG_FSYNC != LOG_FSYNC_NEVER) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long elapsed_ms = (now.tv_sec - last_sync.tv_sec) * 1000L +
+                              (now.tv_nsec - last_sync.tv_nsec) / 1000000L;
+            if (CHAT_LOG_FSYNC == LOG_FSYNC_BATCH || stopping ||
+                elapsed_ms >= CHAT_LOG_FSYNC_INTERVAL_MS) {
+                for (int i = 0; i < LOG_SINK_COUNT; i++) {
+                    if (chat_log.sinks[i].fd != -1) {
+                        fdatasync(chat_log.sinks[i].fd);
+                    }
+                }
+                last_sync = now;
+            }
+        }
+
+        pthread_mutex_lock(&chat_log.lock);
+        if (stopping && chat_logger_empty()) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+    return NULL;
+}
+
+// Compress rotated generations and prune old ones, off the writer thread
+static void* chat_archiver_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&chat_log.lock);
+    while (1) {
+        while (!chat_log.archive_pending && !chat_log.archive_stop) {
+            pthread_cond_wait(&chat_log.archive_wake, &chat_log.lock);
+        }
+        if (!chat_log.archive_pending) {
+            break;
+        }
+        chat_log.archive_pending = 0;
+        pthread_mutex_unlock(&chat_log.lock);
+
+        for (int i = 0; i < LOG_SINK_COUNT; i++) {
+            struct log_sink* sink = &chat_log.sinks[i];
+            if (sink->rotate_bytes || sink->rotate_seconds) {
+                archive_maintain(sink->path, CHAT_LOG_COMPRESS_LEVEL, CHAT_LOG_RETAIN);
+            }
+        }
+
+        pthread_mutex_lock(&chat_log.lock);
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+    return NULL;
+}
+
+static void chat_archiver_kick(void) {
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.archive_pending = 1;
+    if (!chat_log.archiver_running) {
+        // The writer thread already has every signal blocked, and the new
+        // thread inherits that mask
+        chat_log.archiver_running =
+            pthread_create(&chat_log.archiver, NULL, chat_archiver_main, NULL) == 0;
+    }
+    pthread_cond_signal(&chat_log.archive_wake);
+    pthread_mutex_unlock(&chat_log.lock);
+}
+
+// Search indexer.
+//
+// The index (chat_search.h) is shared by every member, like the journal.
+// Whoever's indexer gets the flock appends segments for whole
+// CHAT_SEARCH_SEGMENT_BYTES ranges of journal nobody has indexed yet; the
+// others find the work done. On first run that streams the whole existing
+// journal through, one segment at a time.
+struct search_pair {
+    uint64_t hash;
+    uint32_t offset;
+};
+
+static int search_pair_cmp(const void* a, const void* b) {
+    const struct search_pair* x = a;
+    const struct search_pair* y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Append the segment for journal bytes [start, end). Returns 0 on failure.
+static int search_write_segment(int fd, const struct journal_view* journal, uint64_t start,
+                                uint64_t end) {
+    struct search_pair* pairs = NULL;
+    size_t count = 0, cap = 0;
+    const struct journal_record* rec;
+
+    for (uint64_t offset = start; offset < end; offset += rec->length) {
+        rec = journal_record_at(journal, offset);
+        if (rec->type != MSG_TYPE_NORMAL) {
+            continue;  // Joins and leaves are not worth finding
+        }
+        size_t pos = 0;
+        uint64_t hash;
+        while (search_next_term(journal_content(rec), rec->content_len, &pos, &hash)) {
+            if (count == cap) {
+                cap = cap ? cap * 2 : 16384;
+                struct search_pair* grown = realloc(pairs, cap * sizeof(*pairs));
+                if (!grown) {
+                    free(pairs);
+                    return 0;
+                }
+                pairs = grown;
+            }
+            pairs[count++] = (struct search_pair){hash, (uint32_t)(offset - start)};
+        }
+    }
+    qsort(pairs, count, sizeof(*pairs), search_pair_cmp);
+
+    // A term repeated within one message is posted once
+    size_t postings = 0, terms = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || pairs[i].hash != pairs[i - 1].hash) {
+            terms++;
+        } else if (pairs[i].offset == pairs[i - 1].offset) {
+            continue;
+        }
+        pairs[postings++] = pairs[i];
+    }
+
+    uint32_t length = (uint32_t)search_segment_size(terms, postings);
+    char* out = calloc(1, length);
+    if (!out) {
+        free(pairs);
+        return 0;
+    }
+    struct search_segment* seg = (struct search_segment*)out;
+    *seg = (struct search_segment){
+        .magic = SEARCH_MAGIC,
+        .length = length,
+        .journal_start = start,
+        .journal_end = end,
+        .term_count = (uint32_t)terms,
+        .posting_count = (uint32_t)postings,
+    };
+    struct search_term* term = (struct search_term*)(seg + 1);
+    uint32_t* posting = (uint32_t*)(term + terms);
+    for (size_t i = 0; i < postings; i++) {
+        if (i == 0 || pairs[i].hash != pairs[i - 1].hash) {
+            *term++ = (struct search_term){pairs[i].hash, (uint32_t)i, 0};
+        }
+        term[-1].count++;
+        posting[i] = pairs[i].offset;
+    }
+    memcpy(out + length - sizeof(uint32_t), &length, sizeof(uint32_t));
+    free(pairs);
+
+    int ok = 1;
+    for (size_t done = 0; done < length; ) {
+        ssize_t n = write(fd, out + done, length - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("Failed to write search index");
+            ok = 0;
+            break;
+        }
+        done += (size_t)n;
+    }
+    free(out);
+    return ok;
+}
+
+// Whether the index still describes this journal: it must end on a record
+// boundary the journal has (a journal that was deleted and started over
+// fails this)
+static int search_index_matches(const struct search_view* index, const struct journal_view* journal,
+                                uint64_t journal_end) {
+    return index->journal_end == journal_end ||
+           (index->journal_end < journal_end && journal_record_at(journal, index->journal_end));
+}
+
+// Bring the index up to date. Returns the journal offset indexed up to.
+static uint64_t search_index_update(void) {
+    struct search_view index;
+    struct journal_view journal;
+    uint64_t indexed = 0;
+
+    int fd = open(SEARCH_INDEX_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return 0;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        close(fd);  // Another member is indexing
+        return 0;
+    }
+
+    search_open(&index, SEARCH_INDEX_FILE);
+    if (journal_open(&journal, JOURNAL_FILE, JOURNAL_INDEX_FILE)) {
+        uint64_t end = journal_valid_end(&journal);
+        uint64_t keep = index.valid_end;
+        indexed = index.journal_end;
+        if (!search_index_matches(&index, &journal, end)) {
+            keep = indexed = 0;
+        }
+        // Drop a torn segment, or the whole index if it is stale
+        if (keep < index.size && ftruncate(fd, (off_t)keep) == -1) {
+            perror("Failed to repair search index");
+            end = indexed;
+        }
+
+        while (end - indexed >= CHAT_SEARCH_SEGMENT_BYTES) {
+            pthread_mutex_lock(&chat_log.lock);
+            int stopping = chat_log.index_stop;
+            pthread_mutex_unlock(&chat_log.lock);
+            if (stopping) {
+                break;
+            }
+            uint64_t stop = indexed;
+            while (stop < end && stop - indexed < CHAT_SEARCH_SEGMENT_BYTES) {
+                stop += journal_record_at(&journal, stop)->length;
+            }
+            if (!search_write_segment(fd, &journal, indexed, stop)) {
+                break;
+            }
+            indexed = stop;
+        }
+        journal_close(&journal);
+    }
+    search_close(&index);
+    flock(fd, LOCK_UN);
+    close(fd);
+    return indexed;
+}
+
+static void* chat_indexer_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&chat_log.lock);
+    while (1) {
+        while (!chat_log.index_pending && !chat_log.index_stop) {
+            pthread_cond_wait(&chat_log.index_wake, &chat_log.lock);
+        }
+        if (chat_log.index_stop) {
+            break;
+        }
+        chat_log.index_pending = 0;
+        pthread_mutex_unlock(&chat_log.lock);
+
+        uint64_t indexed = search_index_update();
+        atomic_store(&chat_log.index_due, indexed + CHAT_SEARCH_SEGMENT_BYTES);
+
+        pthread_mutex_lock(&chat_log.lock);
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+    return NULL;
+}
+
+static void chat_indexer_kick(void) {
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.index_pending = 1;
+    pthread_cond_signal(&chat_log.index_wake);
+    pthread_mutex_unlock(&chat_log.lock);
+}
+
+// Flush everything still buffered and stop the writer thread. Registered
+// with atexit() so logs survive any normal exit path.
+static void chat_logger_stop(void) {
+    pthread_mutex_lock(&chat_log.lock);
+    if (!chat_log.running) {
+        pthread_mutex_unlock(&chat_log.lock);
+        return;
+    }
+    chat_log.stop = 1;
+    pthread_cond_signal(&chat_log.wake);
+    pthread_mutex_unlock(&chat_log.lock);
+
+    pthread_join(chat_log.thread, NULL);
+    chat_log.running = 0;
+
+    // Let the final batch's rotation, if any, finish compressing
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.archive_stop = 1;
+    pthread_cond_signal(&chat_log.archive_wake);
+    pthread_mutex_unlock(&chat_log.lock);
+    if (chat_log.archiver_running) {
+        pthread_join(chat_log.archiver, NULL);
+        chat_log.archiver_running = 0;
+    }
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.index_stop = 1;
+    pthread_cond_signal(&chat_log.index_wake);
+    pthread_mutex_unlock(&chat_log.lock);
+    if (chat_log.indexer_running) {
+        pthread_join(chat_log.indexer, NULL);
+        chat_log.indexer_running = 0;
+    }
+    for (int i = 0; i < LOG_SINK_COUNT; i++) {
+        if (chat_log.sinks[i].fd != -1) {
+            close(chat_log.sinks[i].fd);
+            chat_log.sinks[i].fd = -1;
+        }
+    }
+    if (chat_log.index_fd != -1) {
+        close(chat_log.index_fd);
+        chat_log.index_fd = -1;
+    }
+    if (chat_log.dropped > 0) {
+        fprintf(stderr, "Logger dropped %llu record(s): buffer full\n",
+                (unsigned long long)chat_log.dropped);
+    }
+}
+
+static void chat_logger_start(void) {
+    sigset_t all, old;
+
+    for (int i = 0; i < LOG_SINK_COUNT; i++) {
+        struct log_sink* sink = &chat_log.sinks[i];
+        sink->fill = malloc(CHAT_LOG_BUFFER_SIZE);
+        sink->spare = malloc(CHAT_LOG_BUFFER_SIZE);
+        if (!sink->fill || !sink->spare) {
+            perror("Failed to allocate log buffers");
+            return;
+        }
+        sink->fill_cap = sink->spare_cap = CHAT_LOG_BUFFER_SIZE;
+        log_sink_open(sink);
+    }
+    chat_log.index_fd = open(JOURNAL_INDEX_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    // Signals are for the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&chat_log.thread, NULL, chat_logger_main, NULL);
+    // The indexer's first pass catches up on whatever the journal already
+    // holds, building the index from scratch on first run
+    chat_log.index_pending = 1;
+    chat_log.indexer_running = pthread_create(&chat_log.indexer, NULL, chat_indexer_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        perror("pthread_create failed");
+        return;
+    }
+    chat_log.running = 1;
+    atexit(chat_logger_stop);
+}
+
+// Make room for len more bytes in the fill buffer. Buffers grow for large
+// messages up to CHAT_LOG_MAX_BUFFER; past that the record is dropped.
+// Called with the logger lock held.
+static int log_sink_reserve(struct log_sink* sink, size_t len) {
+    size_t need = sink->fill_len + len;
+    if (need <= sink->fill_cap) {
+        return 1;
+    }
+    if (need > CHAT_LOG_MAX_BUFFER) {
+        chat_log.dropped++;
+        return 0;
+    }
+    size_t cap = sink->fill_cap;
+    while (cap < need) {
+        cap *= 2;
+    }
+    char* grown = realloc(sink->fill, cap);
+    if (!grown) {
+        chat_log.dropped++;
+        return 0;
+    }
+    sink->fill = grown;
+    sink->fill_cap = cap;
+    return 1;
+}
+
+// Queue one formatted line for a log file. Never does file I/O.
+static void log_append(int sink_index, const char* user, const char* message) {
+    pthread_once(&chat_log_once, chat_logger_start);
+    TRACE_EVENT(TRACE_LOG, (uint64_t)sink_index);
+
+    pthread_mutex_lock(&chat_log.lock);
+    struct log_sink* sink = &chat_log.sinks[sink_index];
+    if (!chat_log.running || !sink->fill) {
+        pthread_mutex_unlock(&chat_log.lock);
+        return;
+    }
+
+    time_t now = time(NULL);
+    if (now != chat_log.stamp_time) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(chat_log.stamp, sizeof(chat_log.stamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+        chat_log.stamp_time = now;
+    }
+
+    // Timestamp, separators and newline are well under 64 bytes
+    size_t len = strlen(message) + (user ? strlen(user) : 0) + 64;
+    if (log_sink_reserve(sink, len)) {
+        char* out = sink->fill + sink->fill_len;
+        int n = user ? snprintf(out, len, "[%s] %s: %s\n", chat_log.stamp, user, message)
+                     : snprintf(out, len, "[%s] %s\n", chat_log.stamp, message);
+        if (n > 0 && (size_t)n < len) {
+            sink->fill_len += (size_t)n;
+        }
+        if (chat_log.writer_idle) {
+            pthread_cond_signal(&chat_log.wake);
+        }
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+}
+
+// Queue one binary record for the journal. Each message is journaled once,
+// by the member who sent it.
+void journal_append(uint64_t message_id, int type, const char* sender, const char* content,
+                    size_t content_len) {
+    pthread_once(&chat_log_once, chat_logger_start);
+    TRACE_EVENT(TRACE_LOG, LOG_SINK_JOURNAL);
+
+    pthread_mutex_lock(&chat_log.lock);
+    struct log_sink* sink = &chat_log.sinks[LOG_SINK_JOURNAL];
+    if (!chat_log.running || !sink->fill) {
+        pthread_mutex_unlock(&chat_log.lock);
+        return;
+    }
+
+    uint32_t length = journal_record_size(strlen(sender), content_len);
+    if (log_sink_reserve(sink, length)) {
+        if (sink->fill_len == 0) {
+            sink->fill_first_id = message_id;
+        }
+        sink->fill_len += journal_encode(sink->fill + sink->fill_len, message_id,
+                                         (int64_t)time(NULL), type, sender, content, content_len);
+        if (chat_log.writer_idle) {
+            pthread_cond_signal(&chat_log.wake);
+        }
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+}
+
+uint64_t chat_logger_bytes_logged(void) {
+    return atomic_load_explicit(&chat_log.bytes_logged, memory_order_relaxed);
+}
+
+// Logging functions
+void log_system_event(const char *message) {
+    log_append(LOG_SINK_SYSTEM, NULL, message);
+}
+
+void log_message(const char* user, const char* message) {
+    log_append(LOG_SINK_HISTORY, user, message);
+}
+
+// Print the last `count` journaled messages. The journal is memory-mapped
+// and walked backwards from the end, so this does not depend on its size.
+void show_journal_history(size_t count) {
+    struct journal_view view;
+
+    if (!journal_open(&view, JOURNAL_FILE, JOURNAL_INDEX_FILE)) {
+        printf("%sNo message history yet.%s\n", INFO_COLOR, COLOR_RESET);
+        return;
+    }
+
+    uint64_t end = journal_valid_end(&view);
+    uint64_t offset = journal_tail(&view, end, count);
+    printf("%sLast %zu message(s):%s\n", INFO_COLOR, count, COLOR_RESET);
+    while (offset < end) {
+        const struct journal_record* rec = journal_record_at(&view, offset);
+        char sender[MAX_USERNAME_LEN] = {0};
+        char stamp[32];
+        time_t when = (time_t)rec->timestamp;
+        struct tm tm_info;
+
+        memcpy(sender, journal_sender(rec), rec->sender_len < MAX_USERNAME_LEN ? rec->sender_len : MAX_USERNAME_LEN - 1);
+        localtime_r(&when, &tm_info);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M", &tm_info);
+        if (rec->type == MSG_TYPE_SYSTEM) {
+            printf("%s[%s] %.*s%s\n", COLOR_DIM, stamp, (int)rec->content_len, journal_content(rec), COLOR_RESET);
+        } else if (rec->content_len > 0) {
+            printf("%s[%s] %s%s: %s%.*s%s\n", COLOR_DIM, stamp, user_color(sender), sender, COLOR_RESET,
+                   (int)rec->content_len, journal_content(rec), COLOR_RESET);
+        }
+        offset += rec->length;
+    }
+    journal_close(&view);
+}
+
+static void print_log_match(const char* file, const char* line, size_t len) {
+    static const char* last_file = NULL;
+    if (file != last_file) {
+        printf("%s--- %s ---%s\n", INFO_COLOR, file, COLOR_RESET);
+        last_file = file;
+    }
+    printf("%.*s\n", (int)len, line);
+}
+
+// Search chat_history.log and all its rotated generations, oldest first
+void search_log_history(const char* text) {
+    size_t matches = archive_grep(LOG_FILE, text, print_log_match);
+    printf("%s%zu matching line(s).%s\n", INFO_COLOR, matches, COLOR_RESET);
+}
+
+
+// Matching offsets, gathered per index segment
+struct search_hits {
+    uint64_t* offsets;
+    size_t count, cap;
+};
+
+static int search_hits_add(struct search_hits* hits, uint64_t offset) {
+    if (hits->count == hits->cap) {
+        size_t cap = hits->cap ? hits->cap * 2 : 1024;
+        uint64_t* grown = realloc(hits->offsets, cap * sizeof(*grown));
+        if (!grown) {
+            return 0;
+        }
+        hits->offsets = grown;
+        hits->cap = cap;
+    }
+    hits->offsets[hits->count++] = offset;
+    return 1;
+}
+
+// Messages in [start, end) that contain every term, by reading them. Used
+// for the part of the journal the index does not cover yet.
+static void search_scan(const struct journal_view* journal, uint64_t start, uint64_t end,
+                        const uint64_t* terms, size_t term_count, struct search_hits* hits) {
+    const struct journal_record* rec;
+    uint32_t all = (1u << term_count) - 1;
+
+    for (uint64_t offset = start; offset < end; offset += rec->length) {
+        rec = journal_record_at(journal, offset);
+        if (rec->type != MSG_TYPE_NORMAL) {
+            continue;
+        }
+        uint32_t seen = 0;
+        size_t pos = 0;
+        uint64_t hash;
+        while (seen != all && search_next_term(journal_content(rec), rec->content_len, &pos, &hash)) {
+            for (size_t t = 0; t < term_count; t++) {
+                if (terms[t] == hash) {
+                    seen |= 1u << t;
+                }
+            }
+        }
+        if (seen == all) {
+            search_hits_add(hits, offset);
+        }
+    }
+}
+
+// Intersect the terms' posting runs in one segment. Each candidate from the
+// shortest run is binary-searched in the others, moving forward only.
+static void search_segment(const struct search_segment* seg, const uint64_t* terms,
+                           size_t term_count, struct search_hits* hits) {
+    const uint32_t* runs[SEARCH_MAX_TERMS];
+    uint32_t lens[SEARCH_MAX_TERMS];
+    size_t shortest = 0;
+
+    for (size_t t = 0; t < term_count; t++) {
+        if (!(runs[t] = search_lookup(seg, terms[t], &lens[t]))) {
+            return;
+        }
+        if (lens[t] < lens[shortest]) {
+            shortest = t;
+        }
+    }
+    for (uint32_t i = 0; i < lens[shortest]; i++) {
+        uint32_t want = runs[shortest][i];
+        size_t t;
+        for (t = 0; t < term_count; t++) {
+            if (t == shortest) {
+                continue;
+            }
+            uint32_t lo = 0, hi = lens[t];
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (runs[t][mid] < want) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            runs[t] += lo;
+            lens[t] -= lo;
+            if (lens[t] == 0 || runs[t][0] != want) {
+                break;
+            }
+        }
+        if (t == term_count) {
+            search_hits_add(hits, seg->journal_start + want);
+        }
+    }
+}
+
+// Find journaled messages that contain every term of query (whole words,
+// ASCII case-insensitive). The newest `limit` are passed to on_match,
+// oldest first. Returns how many messages matched in all.
+size_t search_history(const char* query, size_t limit,
+                      void (*on_match)(const struct journal_record* rec, void* arg), void* arg) {
+    uint64_t terms[SEARCH_MAX_TERMS];
+    size_t term_count = 0, pos = 0, total = 0;
+    uint64_t hash;
+
+    while (term_count < SEARCH_MAX_TERMS && search_next_term(query, strlen(query), &pos, &hash)) {
+        size_t t = 0;
+        while (t < term_count && terms[t] != hash) {
+            t++;
+        }
+        if (t == term_count) {
+            terms[term_count++] = hash;
+        }
+    }
+    struct journal_view journal;
+    if (term_count == 0 || !journal_open(&journal, JOURNAL_FILE, JOURNAL_INDEX_FILE)) {
+        return 0;
+    }
+
+    // A shared lock for the whole search keeps other members' indexers from
+    // truncating the index under the mapping (they only try LOCK_EX and
+    // skip a round). While one is writing, scan the journal instead.
+    struct search_view index;
+    uint64_t end = journal_valid_end(&journal);
+    int index_fd = open(SEARCH_INDEX_FILE, O_RDONLY | O_CLOEXEC);
+    if (index_fd != -1 && flock(index_fd, LOCK_SH | LOCK_NB) == 0) {
+        search_open(&index, SEARCH_INDEX_FILE);
+    } else {
+        memset(&index, 0, sizeof(index));
+    }
+    if (!search_index_matches(&index, &journal, end)) {
+        index.valid_end = index.journal_end = 0;  // Stale: read the journal instead
+    }
+
+    // Segments, newest first, after the unindexed tail
+    size_t seg_count = 0, seg_cap = 0;
+    uint64_t* segs = NULL;
+    for (uint64_t offset = 0; offset < index.valid_end; ) {
+        if (seg_count == seg_cap) {
+            seg_cap = seg_cap ? seg_cap * 2 : 64;
+            uint64_t* grown = realloc(segs, seg_cap * sizeof(*grown));
+            if (!grown) {
+                break;
+            }
+            segs = grown;
+        }
+        segs[seg_count++] = offset;
+        offset += search_segment_at(&index, offset)->length;
+    }
+
+    // Newest matches, newest first
+    uint64_t* newest = malloc((limit ? limit : 1) * sizeof(*newest));
+    struct search_hits hits = {0};
+    size_t kept = 0;
+    for (size_t s = seg_count + 1; s-- > 0 && newest; ) {
+        hits.count = 0;
+        if (s == seg_count) {
+            search_scan(&journal, index.journal_end, end, terms, term_count, &hits);
+        } else {
+            search_segment(search_segment_at(&index, segs[s]), terms, term_count, &hits);
+        }
+        total += hits.count;
+        for (size_t i = hits.count; i-- > 0 && kept < limit; ) {
+            newest[kept++] = hits.offsets[i];
+        }
+    }
+    while (kept-- > 0) {
+        const struct journal_record* rec = journal_record_at(&journal, newest[kept]);
+        if (rec) {
+            on_match(rec, arg);
+        }
+    }
+
+    free(hits.offsets);
+    free(newest);
+    free(segs);
+    search_close(&index);
+    if (index_fd != -1) {
+        close(index_fd);  // Drops the shared lock
+    }
+    journal_close(&journal);
+    return total;
+}
@@ -0,0 +1,228 @@
+/*
+ * chat_render.c
+ * OS Chat System - terminal output
+ * The client formats everything it shows into one reusable buffer and hands
+ * a whole burst to a single write(), instead of a printf and flush per
+ * message. Colors and cursor control are left out when the output is not a
+ * terminal, and the typing indicator is a timer for the event loop rather
+ * than a sleep.
+ */
+
+#include "chat_common.h"
+
+void render_init(struct chat_render* r, int fd) {
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->tty = isatty(fd);
+    r->colors = r->tty && getenv("NO_COLOR") == NULL;
+}
+
+void render_free(struct chat_render* r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->len = r->cap = 0;
+}
+
+// The process-wide renderer for stdout, shared by the display_* helpers and
+// the client. Only the main thread prints.
+struct chat_render* render_stdout(void) {
+    static struct chat_render out;
+    static int ready = 0;
+    if (!ready) {
+        render_init(&out, STDOUT_FILENO);
+        ready = 1;
+    }
+    return &out;
+}
+
+// Make room for n more bytes. Returns 0 if the buffer cannot grow.
+static int render_reserve(struct chat_render* r, size_t n) {
+    if (r->len + n <= r->cap) {
+        return 1;
+    }
+    size_t cap = r->cap ? r->cap : CHAT_RENDER_BUFFER_SIZE;
+    while (cap < r->len + n) {
+        cap *= 2;
+    }
+    char* grown = realloc(r->buf, cap);
+    if (!grown) {
+        return 0;
+    }
+    r->buf = grown;
+    r->cap = cap;
+    return 1;
+}
+
+void render_append(struct chat_render* r, const char* text, size_t length) {
+    if (!render_reserve(r, length)) {
+        // Out of memory: push out what we have and write this piece as is
+        render_flush(r);
+        struct chat_render direct = {.fd = r->fd, .buf = (char*)text, .len = length};
+        render_flush(&direct);
+        return;
+    }
+    memcpy(r->buf + r->len, text, length);
+    r->len += length;
+}
+
+// Append text from another member: it is checked while it sits in the
+// buffer and repaired there if needed, so the shared copy is never touched
+// and clean text costs one vectorized pass.
+void render_text(struct chat_render* r, const char* text, size_t length) {
+    size_t start = r->len;
+    render_append(r, text, length);
+    if (r->len == start + length) {
+        text_sanitize(r->buf + start, length);
+    }
+}
+
+void render_str(struct chat_render* r, const char* text) {
+    render_append(r, text, strlen(text));
+}
+
+void render_color(struct chat_render* r, const char* code) {
+    if (r->colors) {
+        render_str(r, code);
+    }
+}
+
+void render_vformat(struct chat_render* r, const char* fmt, va_list ap) {
+    va_list again;
+    va_copy(again, ap);
+    int n = vsnprintf(r->buf ? r->buf + r->len : NULL, r->buf ? r->cap - r->len : 0, fmt, ap);
+    if (n > 0 && r->len + (size_t)n + 1 > r->cap) {
+        if (render_reserve(r, (size_t)n + 1)) {
+            vsnprintf(r->buf + r->len, r->cap - r->len, fmt, again);
+        } else {
+            n = 0;
+        }
+    }
+    va_end(again);
+    if (n > 0) {
+        r->len += (size_t)n;
+    }
+}
+
+void render_format(struct chat_render* r, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    render_vformat(r, fmt, ap);
+    va_end(ap);
+}
+
+// One colored status line
+void render_line(struct chat_render* r, const char* color, const char* fmt, ...) {
+    va_list ap;
+    render_color(r, color);
+    va_start(ap, fmt);
+    render_vformat(r, fmt, ap);
+    va_end(ap);
+    render_color(r, COLOR_RESET);
+    render_append(r, "\n", 1);
+}
+
+// "HH:MM" for the current time. localtime() and strftime() only run when
+// the second changes, not for every message in a burst.
+static const char* render_timestamp(struct chat_render* r) {
+    time_t now = time(NULL);
+    if (now != r->stamp_time) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(r->stamp, sizeof(r->stamp), "%H:%M", &tm_info);
+        r->stamp_time = now;
+    }
+    return r->stamp;
+}
+
+void render_message(struct chat_render* r, const char* sender, const char* text, size_t length,
+                    const char* color, int is_own) {
+    render_color(r, COLOR_DIM);
+    render_append(r, "[", 1);
+    render_str(r, render_timestamp(r));
+    render_append(r, "] ", 2);
+    render_color(r, color);
+    if (is_own) {
+        render_append(r, "You", 3);
+    } else {
+        render_text(r, sender, strnlen(sender, MAX_USERNAME_LEN));
+    }
+    render_append(r, ": ", 2);
+    render_color(r, COLOR_RESET);
+    render_text(r, text, length);
+    render_append(r, "\n", 1);
+}
+
+// Wipe the current terminal line (a pending prompt or typing indicator).
+// A no-op when the output is not a terminal.
+void render_clear_line(struct chat_render* r) {
+    if (r->tty) {
+        render_append(r, "\r\033[K", 4);
+    }
+    r->typing_until = 0;
+}
+
+// Show "name is typing..." on the current line for duration_ms. Nothing
+// blocks: the event loop polls with render_timeout() and calls
+// render_tick() to take the indicator down again.
+void render_typing(struct chat_render* r, const char* name, const char* color, int duration_ms) {
+    if (!r->tty) {
+        return;
+    }
+    render_clear_line(r);
+    render_color(r, COLOR_DIM);
+    render_color(r, color);
+    render_format(r, "%s is typing...", name);
+    render_color(r, COLOR_RESET);
+    r->typing_until = chat_now_ns() + (uint64_t)duration_ms * 1000000ull;
+}
+
+// Milliseconds until the next timer is due, or -1 if none is armed
+int render_timeout(const struct chat_render* r) {
+    if (r->typing_until == 0) {
+        return -1;
+    }
+    uint64_t now = chat_now_ns();
+    if (now >= r->typing_until) {
+        return 0;
+    }
+    return (int)((r->typing_until - now + 999999) / 1000000);
+}
+
+// Fire due timers. Returns 1 if the indicator was taken down, so the caller
+// can redraw its prompt.
+int render_tick(struct chat_render* r) {
+    if (r->typing_until == 0 || chat_now_ns() < r->typing_until) {
+        return 0;
+    }
+    render_clear_line(r);
+    return 1;
+}
+
+// Write out everything buffered with one write() (more only if the
+// terminal takes a partial write). stdio output queued before it goes
+// first so the two never interleave out of order. Returns -1 on error.
+int render_flush(struct chat_render* r) {
+    if (r->len == 0) {
+        return 0;
+    }
+    fflush(stdout);
+    size_t done = 0;
+    while (done < r->len) {
+        ssize_t n = write(r->fd, r->buf + done, r->len - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                struct pollfd pfd = {.fd = r->fd, .events = POLLOUT};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            r->len = 0;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    r->len = 0;
+    return 0;
+}
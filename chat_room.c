@@ -0,0 +1,803 @@
+/*
+ * chat_room.c
+ * OS Chat System - shared-memory transport
+ * The room segment: futex and semaphore helpers, the lock-free broadcast
+ * ring, the message arena, membership and the publish notifier.
+ */
+
+#include "chat_common.h"
+
+// Futex and semaphore calls made by this process, so benchmarks can report
+// syscalls per message
+_Atomic uint64_t chat_syscalls;
+
+// Futex helpers. The segment is shared between processes, so these must not
+// use FUTEX_PRIVATE_FLAG.
+
+// Sleep while *addr == expected. Returns 0 when woken (or the value already
+// changed) and -1 with errno ETIMEDOUT when the timeout expires.
+int futex_wait(_Atomic uint32_t* addr, uint32_t expected, const struct timespec* timeout) {
+    atomic_fetch_add_explicit(&chat_syscalls, 1, memory_order_relaxed);
+    long rc = syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, expected, timeout, NULL, 0);
+    if (rc == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    return (int)rc;
+}
+
+void futex_wake(_Atomic uint32_t* addr, int count) {
+    atomic_fetch_add_explicit(&chat_syscalls, 1, memory_order_relaxed);
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Semaphore helper functions
+void sem_wait(int semid, int semnum) {
+    struct sembuf sb = {semnum, -1, 0};
+    atomic_fetch_add_explicit(&chat_syscalls, 1, memory_order_relaxed);
+    if (semop(semid, &sb, 1) == -1) {
+        perror("sem_wait failed");
+        exit(1);
+    }
+}
+
+void sem_signal(int semid, int semnum) {
+    struct sembuf sb = {semnum, +1, 0};
+    atomic_fetch_add_explicit(&chat_syscalls, 1, memory_order_relaxed);
+    if (semop(semid, &sb, 1) == -1) {
+        perror("sem_signal failed");
+        exit(1);
+    }
+}
+
+// Recompute the reclaim point from the participant table. Only called when
+// the ring looks full (or a member left), so the O(MAX_USERS) scan stays off
+// the common send path. Returns the new tail.
+uint32_t room_reclaim(struct shmseg* shm) {
+    uint32_t head = atomic_load(&shm->head);
+    uint32_t behind = 0;
+
+    for (int i = 0; i < MAX_USERS; i++) {
+        struct chat_participant* p = &shm->participants[i];
+        // Orphans count too: their unread messages wait for a resume
+        if (atomic_load_explicit(&p->state, memory_order_acquire) == PARTICIPANT_FREE) {
+            continue;
+        }
+        uint32_t lag = head - atomic_load_explicit(&p->cursor, memory_order_acquire);
+        if (lag <= shm->header.ring_capacity && lag > behind) {
+            behind = lag;
+        }
+    }
+
+    uint32_t tail = atomic_load(&shm->tail);
+    uint32_t candidate = head - behind;
+    while ((int32_t)(candidate - tail) > 0 &&
+           !atomic_compare_exchange_weak(&shm->tail, &tail, candidate)) {
+    }
+    return atomic_load(&shm->tail);
+}
+
+// Arena helpers
+
+static char* arena_block(struct shmseg* shm, uint32_t block) {
+    return (char*)shm + shm->header.arena_offset + (size_t)(block & ARENA_INDEX_MASK) * ARENA_MIN_BLOCK;
+}
+
+static int arena_class(size_t size) {
+    int cls = 0;
+    while (((size_t)ARENA_MIN_BLOCK << cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+static void arena_free(struct shmseg* shm, uint32_t block) {
+    _Atomic uint64_t* list = &shm->arena.free_lists[block >> ARENA_CLASS_SHIFT];
+    _Atomic uint32_t* next = (_Atomic uint32_t*)arena_block(shm, block);
+    uint64_t head = atomic_load(list);
+    do {
+        atomic_store_explicit(next, (uint32_t)head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(list, &head, ((head >> 32) + 1) << 32 | block));
+}
+
+static uint32_t arena_pop(struct shmseg* shm, int cls) {
+    _Atomic uint64_t* list = &shm->arena.free_lists[cls];
+    uint64_t head = atomic_load(list);
+    while ((uint32_t)head != 0) {
+        // The block may be popped and reused under us; the tag makes the
+        // CAS fail in that case, and the arena is always mapped so the
+        // stale read itself is harmless
+        _Atomic uint32_t* next = (_Atomic uint32_t*)arena_block(shm, (uint32_t)head);
+        uint64_t replacement = ((head >> 32) + 1) << 32 | atomic_load_explicit(next, memory_order_relaxed);
+        if (atomic_compare_exchange_weak(list, &head, replacement)) {
+            return (uint32_t)head;
+        }
+    }
+    return 0;
+}
+
+static uint32_t arena_bump(struct shmseg* shm, int cls) {
+    uint64_t size = (uint64_t)ARENA_MIN_BLOCK << cls;
+    uint64_t top = atomic_load(&shm->arena.top);
+    do {
+        if (ARENA_MIN_BLOCK + top + size > shm->header.arena_size) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&shm->arena.top, &top, top + size));
+    return (uint32_t)cls << ARENA_CLASS_SHIFT | (uint32_t)((ARENA_MIN_BLOCK + top) / ARENA_MIN_BLOCK);
+}
+
+// Free the bodies of messages every reader has passed but whose slots have
+// not been reused yet. Only runs when an allocation fails.
+static void arena_sweep(struct shmseg* shm) {
+    uint32_t tail = room_reclaim(shm);
+    for (uint32_t i = 0; i < shm->header.ring_capacity; i++) {
+        _Atomic uint64_t* payload = &shm->slots[i].payload;
+        uint64_t ref = atomic_load(payload);
+        if (ref != 0 && (int32_t)(tail - ((uint32_t)(ref >> 32) - 1)) > 0 &&
+            atomic_compare_exchange_strong(payload, &ref, 0)) {
+            arena_free(shm, (uint32_t)ref);
+        }
+    }
+}
+
+// Allocate a block of at least size bytes. Returns 0 if the arena is full.
+static uint32_t arena_alloc(struct shmseg* shm, size_t size) {
+    int cls = arena_class(size);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint32_t block = arena_pop(shm, cls);
+        if (!block) {
+            block = arena_bump(shm, cls);
+        }
+        // Blocks are never split, but a larger free one beats failing
+        for (int bigger = cls + 1; !block && bigger < ARENA_CLASSES; bigger++) {
+            block = arena_pop(shm, bigger);
+        }
+        if (block) {
+            return block;
+        }
+        arena_sweep(shm);
+    }
+    return 0;
+}
+
+// Fill in a claimed slot and mark it published
+static void room_fill_slot(struct shmseg* shm, uint32_t seq, const struct chat_participant* from,
+                           const struct chat_outgoing* msg, uint32_t block, uint64_t now) {
+    struct chat_slot* slot = room_slot(shm, seq);
+
+    // Mark the slot as being rewritten before touching it
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    // Free the previous occupant's body unless a sweep already did
+    uint64_t old = atomic_exchange(&slot->payload, 0);
+    if (old != 0) {
+        arena_free(shm, (uint32_t)old);
+    }
+
+    if (from) {
+        slot->sender_id = from->id;
+        memcpy(slot->sender, from->name, MAX_USERNAME_LEN);
+    } else {
+        slot->sender_id = 0;
+        slot->sender[0] = '\0';
+    }
+    slot->type = msg->type;
+    slot->length = (uint32_t)msg->length;
+    slot->sent_ns = now;
+    atomic_store_explicit(&slot->delivered, 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->read, 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->payload, (uint64_t)(seq + 1) << 32 | block, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+// Publish up to count messages as one run of consecutive sequences: one CAS
+// on head claims them all and readers get a single wakeup. Lock-free and
+// syscall-free unless a reader is asleep. Returns how many messages from
+// the front of msgs were published (0 if the ring or the arena is full, so
+// the caller can apply backpressure) and stores the first one's ID.
+size_t room_publish_batch(struct shmseg* shm, const struct chat_participant* from,
+                          const struct chat_outgoing* msgs, size_t count, uint32_t* first_id) {
+    uint32_t blocks[CHAT_SEND_BATCH_MAX];
+    size_t ready = 0;
+
+    if (count > CHAT_SEND_BATCH_MAX) {
+        count = CHAT_SEND_BATCH_MAX;
+    }
+
+    // Copy the bodies in before claiming sequences: once claimed, a slot
+    // must be published or readers would stall on it
+    for (; ready < count; ready++) {
+        uint32_t block = arena_alloc(shm, msgs[ready].length + 1);
+        if (!block) {
+            break;
+        }
+        char* body = arena_block(shm, block);
+        memcpy(body, msgs[ready].content, msgs[ready].length);
+        body[msgs[ready].length] = '\0';
+        blocks[ready] = block;
+    }
+    if (ready == 0) {
+        stat_add(&shm->stats.arena_full, 1);
+        TRACE_EVENT(TRACE_ROOM_FULL, 0);
+        return 0;
+    }
+
+    // Claim as many consecutive sequences as the ring has room for
+    uint32_t seq = atomic_load_explicit(&shm->head, memory_order_relaxed);
+    uint32_t take;
+    do {
+        uint32_t tail = atomic_load_explicit(&shm->tail, memory_order_acquire);
+        if (seq - tail + ready > shm->header.ring_capacity) {
+            tail = room_reclaim(shm);
+        }
+        uint32_t room = shm->header.ring_capacity - (seq - tail);
+        take = room < ready ? room : (uint32_t)ready;
+        if (take == 0) {
+            for (size_t i = 0; i < ready; i++) {
+                arena_free(shm, blocks[i]);
+            }
+            stat_add(&shm->stats.queue_full, 1);
+            TRACE_EVENT(TRACE_ROOM_FULL, 1);
+            return 0; // Full
+        }
+    } while (!atomic_compare_exchange_weak(&shm->head, &seq, seq + take));
+    stat_max(&shm->stats.max_depth, seq + take - atomic_load_explicit(&shm->tail, memory_order_relaxed));
+
+    for (size_t i = take; i < ready; i++) {
+        arena_free(shm, blocks[i]);
+    }
+    uint64_t now = chat_now_ns();
+    for (uint32_t i = 0; i < take; i++) {
+        room_fill_slot(shm, seq + i, from, &msgs[i], blocks[i], now);
+    }
+    atomic_fetch_add(&shm->published, take);
+
+    // The seq_cst increment above orders the publish before the waiter
+    // check (pairs with the increment in room_wait_published)
+    if (atomic_load(&shm->data_waiters) > 0) {
+        futex_wake(&shm->published, INT_MAX);
+    }
+    *first_id = seq + 1;
+    TRACE_EVENT(TRACE_PUBLISH, (uint64_t)(seq + 1) << 32 | take);
+    return take;
+}
+
+// Publish one message. Returns the message ID, or 0 if the ring or the
+// arena is full.
+uint32_t room_publish(struct shmseg* shm, const struct chat_participant* from, const char* content,
+                      size_t length, int type) {
+    struct chat_outgoing msg = {content, length, type};
+    uint32_t id;
+    return room_publish_batch(shm, from, &msg, 1, &id) ? id : 0;
+}
+
+static uint64_t room_member_bit(struct shmseg* shm, const struct chat_participant* me) {
+    return 1ull << (me - shm->participants);
+}
+
+// Set our delivered bit on a message and, the first time, record how long
+// it took to reach us. room_read() can return the same message more than
+// once before it is consumed; only the first counts.
+static void room_ack_delivery(struct shmseg* shm, struct chat_participant* me, struct chat_slot* slot,
+                              uint64_t sent_ns) {
+    uint64_t bit = room_member_bit(shm, me);
+    if (atomic_fetch_or_explicit(&slot->delivered, bit, memory_order_relaxed) & bit) {
+        return;
+    }
+    uint64_t now = chat_now_ns();
+    uint64_t latency = now > sent_ns ? now - sent_ns : 0;
+    atomic_store_explicit(&me->latency_ns, latency, memory_order_relaxed);
+    stat_add(&shm->stats.latency_counts[hist_bucket(latency)], 1);
+    stat_max(&shm->stats.latency_max_ns, latency);
+}
+
+// Look at the next message at this member's cursor without consuming it.
+// Returns 0 if nothing new has been published yet. The body is read in
+// place, so call room_advance() only once done with msg->content.
+int room_read(struct shmseg* shm, struct chat_participant* me, struct chat_message* msg) {
+    while (1) {
+        uint32_t cursor = atomic_load_explicit(&me->cursor, memory_order_relaxed);
+        struct chat_slot* slot = room_slot(shm, cursor);
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if (seq == cursor + 1) {
+            uint64_t ref = atomic_load_explicit(&slot->payload, memory_order_relaxed);
+            memcpy(msg->sender, slot->sender, MAX_USERNAME_LEN);
+            msg->sender_id = slot->sender_id;
+            msg->type = slot->type;
+            msg->length = slot->length;
+            msg->message_id = (int)seq;
+            msg->sent_ns = slot->sent_ns;
+            atomic_thread_fence(memory_order_acquire);
+            // Still the same message, and not behind the reclaim point (in
+            // which case its body could be swept while we use it)?
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq &&
+                (int32_t)(atomic_load(&shm->tail) - cursor) <= 0) {
+                msg->content = arena_block(shm, (uint32_t)ref);
+                if (msg->sender_id != me->id) {
+                    room_ack_delivery(shm, me, slot, msg->sent_ns);
+                }
+                return 1;
+            }
+        } else if (seq == 0 || (int32_t)(seq - (cursor + 1)) < 0) {
+            return 0; // Not published yet
+        }
+
+        // Lapped: the slot was reused before we got to it (only possible
+        // while we were joining). Skip ahead to the oldest retained message.
+        atomic_store(&me->cursor, atomic_load(&shm->tail));
+    }
+}
+
+// Mark the message last returned by room_read() as shown to the user. Call
+// it before room_advance(), while the slot still belongs to the message.
+void room_mark_read(struct shmseg* shm, const struct chat_participant* me, const struct chat_message* msg) {
+    struct chat_slot* slot = room_slot(shm, (uint32_t)msg->message_id - 1);
+    atomic_fetch_or_explicit(&slot->read, room_member_bit(shm, me), memory_order_relaxed);
+}
+
+// Consume the message last returned by room_read()
+void room_advance(struct shmseg* shm, struct chat_participant* me) {
+    uint32_t cursor = atomic_fetch_add(&me->cursor, 1);
+    TRACE_EVENT(TRACE_CONSUME, cursor + 1);
+    // A blocked sender may be waiting for exactly this cursor. Advancing
+    // tail ourselves changes the futex word, so the wakeup cannot be lost
+    // between its check and its sleep.
+    if (atomic_load(&shm->space_waiters) > 0) {
+        room_reclaim(shm);
+        futex_wake(&shm->tail, INT_MAX);
+    }
+}
+
+// Which members have taken delivery of and shown message id (as returned
+// by room_publish()), one bit per participant index. Returns 0 once the
+// slot has been reused for a later message and the answer is gone.
+int room_message_acks(struct shmseg* shm, uint32_t id, uint64_t* delivered, uint64_t* read) {
+    struct chat_slot* slot = room_slot(shm, id - 1);
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != id) {
+        return 0;
+    }
+    *delivered = atomic_load_explicit(&slot->delivered, memory_order_relaxed);
+    *read = atomic_load_explicit(&slot->read, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == id;
+}
+
+// Delivery latency at the given percentile (0-100) across the room, and
+// how many deliveries have been recorded
+uint64_t room_latency_percentile(struct shmseg* shm, double percentile, uint64_t* total) {
+    _Atomic uint64_t* counts = shm->stats.latency_counts;
+    uint64_t max = atomic_load_explicit(&shm->stats.latency_max_ns, memory_order_relaxed);
+    uint64_t sum = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        sum += atomic_load_explicit(&counts[i], memory_order_relaxed);
+    }
+    *total = sum;
+    if (sum == 0) {
+        return 0;
+    }
+    // Same ranking as hist_percentile_counts(), over the live counters;
+    // deliveries recorded between the two passes only push the answer up
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)sum + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&counts[i], memory_order_relaxed);
+        if (seen >= (rank ? rank : 1)) {
+            uint64_t value = hist_bucket_value(i);
+            return value > max ? max : value;
+        }
+    }
+    return max;
+}
+
+// Block until the publish counter moves past `seen`. A NULL timeout waits
+// forever. Returns 1 if something was published, 0 on timeout.
+int room_wait_published(struct shmseg* shm, uint32_t seen, const struct timespec* timeout) {
+    if (atomic_load_explicit(&shm->published, memory_order_acquire) != seen) {
+        return 1;
+    }
+
+    atomic_fetch_add(&shm->data_waiters, 1);
+    if (atomic_load(&shm->published) == seen) {
+        futex_wait(&shm->published, seen, timeout);
+    }
+    atomic_fetch_sub(&shm->data_waiters, 1);
+
+    return atomic_load_explicit(&shm->published, memory_order_acquire) != seen;
+}
+
+// Block until the reclaim point moves past `seen_tail`, which is what frees
+// both ring slots and arena space. A NULL timeout waits forever. Returns 1
+// if it moved, 0 on timeout.
+int room_wait_writable(struct shmseg* shm, uint32_t seen_tail, const struct timespec* timeout) {
+    uint64_t start = chat_trace_enabled ? chat_now_ns() : 0;
+    atomic_fetch_add(&shm->space_waiters, 1);
+    if (room_reclaim(shm) == seen_tail) {
+        futex_wait(&shm->tail, seen_tail, timeout);
+    }
+    atomic_fetch_sub(&shm->space_waiters, 1);
+    TRACE_EVENT(TRACE_SPACE_WAIT, chat_now_ns() - start);
+    return atomic_load(&shm->tail) != seen_tail;
+}
+
+// Semaphore 0 with SEM_UNDO, so the kernel releases it if we die holding it.
+// Returns 0 if IPC_NOWAIT was given and the lock is busy.
+static int room_semop(int semid, short op, short flags) {
+    struct sembuf sb = {0, op, (short)(SEM_UNDO | flags)};
+    atomic_fetch_add_explicit(&chat_syscalls, 1, memory_order_relaxed);
+    while (semop(semid, &sb, 1) == -1) {
+        if (errno == EAGAIN && (flags & IPC_NOWAIT)) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            perror("semop failed");
+            exit(1);
+        }
+    }
+    return 1;
+}
+
+// Semaphore 0, timed so chatstat can show membership lock contention. Use
+// room_lock(), which passes the caller's name and line for tracing.
+void room_lock_at(struct shmseg* shm, int semid, const char* func, int line) {
+    if (chat_trace_enabled) {
+        trace_event_at(TRACE_LOCK_REQUEST, func, line, (uint64_t)semid);
+    }
+    uint64_t start = chat_now_ns();
+    room_semop(semid, -1, 0);
+    uint64_t waited = chat_now_ns() - start;
+    if (chat_trace_enabled) {
+        trace_event_at(TRACE_LOCK_ACQUIRED, func, line, (uint64_t)semid);
+    }
+    stat_add(&shm->stats.lock_acquires, 1);
+    stat_add(&shm->stats.lock_wait_ns, waited);
+    stat_max(&shm->stats.lock_wait_max_ns, waited);
+}
+
+void room_unlock_at(int semid, const char* func, int line) {
+    if (chat_trace_enabled) {
+        trace_event_at(TRACE_LOCK_RELEASED, func, line, (uint64_t)semid);
+    }
+    room_semop(semid, +1, 0);
+}
+
+static uint64_t room_now_seconds(void) {
+    return chat_now_ns() / 1000000000ull;
+}
+
+// kill(pid, 0) fails with ESRCH once the process is gone; EPERM means it
+// exists under another user
+static int room_pid_alive(pid_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// Orphan members whose process died without leaving, and release orphans
+// nobody resumed in time. Caller holds semaphore 0. Returns how many entries
+// changed state.
+static int room_reap(struct shmseg* shm) {
+    uint64_t now = room_now_seconds();
+    char event[96];
+    int changed = 0;
+
+    for (int i = 0; i < MAX_USERS; i++) {
+        struct chat_participant* p = &shm->participants[i];
+        uint32_t state = atomic_load(&p->state);
+        if (state == PARTICIPANT_ACTIVE && !room_pid_alive(p->pid)) {
+            p->orphaned_at = now;
+            atomic_store(&p->state, PARTICIPANT_ORPHANED);
+            snprintf(event, sizeof(event), "%.*s (pid %d) died; holding %u message(s) for a restart",
+                     MAX_USERNAME_LEN, p->name, (int)p->pid,
+                     atomic_load(&shm->head) - atomic_load(&p->cursor));
+        } else if (state == PARTICIPANT_ORPHANED && now - p->orphaned_at >= CHAT_RESUME_GRACE_SECONDS) {
+            atomic_store(&p->state, PARTICIPANT_FREE);
+            shm->participant_count--;
+            snprintf(event, sizeof(event), "%.*s was not resumed; released its messages",
+                     MAX_USERNAME_LEN, p->name);
+        } else {
+            continue;
+        }
+        atomic_fetch_add(&shm->header.generation, 1);
+        log_system_event(event);
+        changed++;
+    }
+    return changed;
+}
+
+// For a sender stuck on a full ring: a member that died may be what pins
+// it, or an orphan past its grace period. Scans at most once a second across
+// the room and skips the scan while the membership lock is busy. Returns 1
+// if the reclaim point may have moved.
+int room_recover(struct shmseg* shm, int semid) {
+    uint64_t now = room_now_seconds();
+    uint64_t last = atomic_load(&shm->last_recovery);
+    if (last == now || !atomic_compare_exchange_strong(&shm->last_recovery, &last, now)) {
+        return 0;
+    }
+    TRACE_EVENT(TRACE_LOCK_REQUEST, (uint64_t)semid);
+    if (!room_semop(semid, -1, IPC_NOWAIT)) {
+        TRACE_EVENT(TRACE_LOCK_BUSY, (uint64_t)semid);
+        return 0;
+    }
+    TRACE_EVENT(TRACE_LOCK_ACQUIRED, (uint64_t)semid);
+    int changed = room_reap(shm);
+    room_unlock(semid);
+
+    if (changed) {
+        room_reclaim(shm);
+        futex_wake(&shm->tail, INT_MAX);
+    }
+    return changed > 0;
+}
+
+// Hand out a sender ID. Caller holds semaphore 0.
+static uint32_t room_next_sender_id(struct shmseg* shm) {
+    // 0 marks anonymous publishers, so skip it on wraparound
+    if (++shm->last_sender_id == 0) {
+        shm->last_sender_id = 1;
+    }
+    return shm->last_sender_id;
+}
+
+// A sender ID for a publisher that is not in the participant table, such
+// as a chatd socket client. Takes semaphore 0 only for the increment.
+uint32_t room_new_sender_id(struct shmseg* shm, int semid) {
+    room_lock(shm, semid);
+    uint32_t id = room_next_sender_id(shm);
+    room_unlock(semid);
+    return id;
+}
+
+// Take a slot in the participant table. An orphaned entry with this name is
+// resumed as is, cursor included, so its unread messages are delivered;
+// *resumed (if given) tells which happened. Returns the slot index, or -1 if
+// the room is full or a live member already uses the name.
+int room_join(struct shmseg* shm, int semid, const char* name, int* resumed) {
+    int index = -1, orphan = -1;
+
+    room_lock(shm, semid);
+    room_reap(shm);
+    for (int i = 0; i < MAX_USERS; i++) {
+        struct chat_participant* p = &shm->participants[i];
+        uint32_t state = atomic_load(&p->state);
+        if (state == PARTICIPANT_FREE) {
+            if (index == -1) {
+                index = i;
+            }
+        } else if (strncmp(p->name, name, MAX_USERNAME_LEN) == 0) {
+            if (state == PARTICIPANT_ORPHANED) {
+                orphan = i;
+            } else {
+                index = -1;
+            }
+            break;
+        }
+    }
+    if (resumed) {
+        *resumed = orphan != -1;
+    }
+
+    if (orphan != -1) {
+        // Same id, so messages we sent before dying are still recognized
+        // as our own
+        struct chat_participant* p = &shm->participants[orphan];
+        p->pid = getpid();
+        atomic_store(&p->state, PARTICIPANT_ACTIVE);
+        atomic_fetch_add(&shm->header.generation, 1);
+        index = orphan;
+    } else if (index != -1) {
+        struct chat_participant* p = &shm->participants[index];
+        strncpy(p->name, name, MAX_USERNAME_LEN - 1);
+        p->name[MAX_USERNAME_LEN - 1] = '\0';
+        p->pid = getpid();
+        p->id = room_next_sender_id(shm);
+        atomic_store_explicit(&p->sent, 0, memory_order_relaxed);
+        atomic_store_explicit(&p->received, 0, memory_order_relaxed);
+        atomic_store_explicit(&p->latency_ns, 0, memory_order_relaxed);
+        atomic_store_explicit(&p->outbox_depth, 0, memory_order_relaxed);
+        atomic_store_explicit(&p->outbox_drained, 0, memory_order_relaxed);
+        // Hold the reclaim point where it is while we become visible, then
+        // move to the head: new members only see messages from now on
+        atomic_store(&p->cursor, atomic_load(&shm->tail));
+        atomic_store(&p->state, PARTICIPANT_ACTIVE);
+        atomic_store(&p->cursor, atomic_load(&shm->head));
+        shm->participant_count++;
+    }
+    room_unlock(semid);
+    return index;
+}
+
+// Give up a participant slot. Returns how many members are left, counting
+// orphans still waiting to be resumed.
+uint32_t room_leave(struct shmseg* shm, int semid, int index) {
+    room_lock(shm, semid);
+    atomic_store(&shm->participants[index].state, PARTICIPANT_FREE);
+    shm->participant_count--;
+    room_reap(shm);
+    uint32_t remaining = shm->participant_count;
+    room_unlock(semid);
+
+    // Our cursor no longer holds anything back
+    if (atomic_load(&shm->space_waiters) > 0) {
+        room_reclaim(shm);
+        futex_wake(&shm->tail, INT_MAX);
+    }
+    return remaining;
+}
+
+// Until this runs the membership lock reads 0, so early joiners simply
+// block in room_join
+static void room_sem_reset(int semid) {
+    union semun {
+        int val;
+        struct semid_ds *buf;
+        unsigned short *array;
+    } arg;
+    arg.val = 1;
+    semctl(semid, 0, SETVAL, arg);
+}
+
+// Whether an existing segment was set up by a compatible build. Waits up to
+// CHAT_ATTACH_TIMEOUT_MS for a creator that is still initializing it.
+static int room_segment_valid(struct shmseg* shm, size_t mapped) {
+    struct timespec step = {0, 10 * 1000000L};
+    for (int waited = 0; atomic_load(&shm->system_ready) == 0; waited += 10) {
+        if (waited >= CHAT_ATTACH_TIMEOUT_MS) {
+            return 0;
+        }
+        futex_wait(&shm->system_ready, 0, &step);
+    }
+    return room_layout_valid(shm, mapped);
+}
+
+// Attach to a channel's segment and semaphore ("" is the main room),
+// creating and initializing them if this is the first member. The segment
+// comes from the backend in room_config; a new one gets its ring and arena
+// sizes from there too. An existing room is reused as is, with whatever
+// messages are queued in it; it is only replaced when it is unusable
+// (another build's layout, or a creator that died mid-setup) and nothing
+// else is attached to it. Returns 1 on success.
+int room_attach(struct room_segment* seg, const char* channel, int* semid_out) {
+    key_t sem_key = room_channel_key(SEM_KEY, channel);
+
+    for (int attempt = 0; ; attempt++) {
+        int created_sem = 0;
+        int semid = semget(sem_key, 1, IPC_CREAT | IPC_EXCL | 0666);
+        if (semid != -1) {
+            created_sem = 1;
+        } else if (errno == EEXIST) {
+            semid = semget(sem_key, 1, 0666);
+        }
+        if (semid == -1) {
+            perror("semget failed");
+            printf("%sFailed to get semaphore with key: 0x%x%s\n", ERROR_COLOR, sem_key, COLOR_RESET);
+            return 0;
+        }
+
+        int created_shm = segment_create(seg, channel, 1);
+        if (created_shm == 0) {
+            int found = segment_open(seg, channel, 0);
+            if (found == 0) {
+                continue;  // Removed since we tried to create it
+            }
+            if (found == -1) {
+                return 0;
+            }
+        } else if (created_shm == -1) {
+            return 0;
+        }
+        struct shmseg* shm = seg->shm;
+
+        if (created_shm) {
+            // A fresh segment is zero-filled, which is already an empty ring.
+            // It also gets a fresh lock, in case the semaphore outlived an
+            // older room; nobody can be joining before system_ready is set.
+            room_sem_reset(semid);
+            room_format(shm, room_config.ring_capacity, room_config.arena_size);
+            memcpy(shm->header.channel, seg->channel, sizeof(shm->header.channel));
+            shm->epoch = (uint64_t)time(NULL);
+            shm->header.creator = getpid();
+            atomic_store(&shm->header.generation, 1);
+            atomic_store(&shm->header.magic, ROOM_MAGIC);
+            atomic_store(&shm->system_ready, 1);
+            futex_wake(&shm->system_ready, INT_MAX);
+            log_system_event("Chat room initialized");
+        } else if (!shm || !room_segment_valid(shm, seg->size)) {
+            // Only replace it if nobody else is attached
+            int alone = segment_sole_user(seg);
+            if (!alone || attempt > 0) {
+                printf("%sThe chat room segment (%s, key 0x%x) is from an incompatible build or was never "
+                       "initialized, and is still in use. Close its members or run "
+                       "'make clean-resources'.%s\n", ERROR_COLOR, room_backend_name(seg->backend),
+                       room_channel_key(SHM_KEY, seg->channel), COLOR_RESET);
+                segment_detach(seg);
+                return 0;
+            }
+            cleanup_resources(seg, semid);
+            segment_detach(seg);
+            log_system_event("Replaced a stale chat room segment");
+            continue;
+        }
+
+        if (strncmp(shm->header.channel, seg->channel, sizeof(shm->header.channel)) != 0) {
+            printf("%sChannel '%s' hashes to the same key as channel '%.*s'; pick another name.%s\n",
+                   ERROR_COLOR, seg->channel, (int)sizeof(shm->header.channel), shm->header.channel,
+                   COLOR_RESET);
+            segment_detach(seg);
+            return 0;
+        }
+        if (created_sem && !created_shm) {
+            room_sem_reset(semid);
+        }
+
+        *semid_out = semid;
+        return 1;
+    }
+}
+
+void cleanup_resources(struct room_segment* seg, int semid) {
+    if (seg) {
+        segment_remove(seg);
+    }
+    if (semid != -1) {
+        semctl(semid, 0, IPC_RMID);
+    }
+}
+
+static void* chat_notifier_main(void* arg) {
+    struct chat_notifier* notifier = arg;
+    uint32_t seen = notifier->seen;
+    uint64_t one = 1;
+
+    while (!atomic_load(&notifier->stop)) {
+        if (!room_wait_published(notifier->shm, seen, NULL)) {
+            continue;
+        }
+        seen = atomic_load(&notifier->shm->published);
+        if (write(notifier->efd, &one, sizeof(one)) != sizeof(one)) {
+            perror("eventfd write failed");
+        }
+    }
+    return NULL;
+}
+
+int chat_notifier_start(struct chat_notifier* notifier, struct shmseg* shm) {
+    sigset_t all, old;
+
+    notifier->shm = shm;
+    // Read before the caller's first drain, so a publish between that drain
+    // and the thread starting still wakes it
+    notifier->seen = atomic_load(&shm->published);
+    atomic_store(&notifier->stop, 0);
+    notifier->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (notifier->efd == -1) {
+        perror("eventfd failed");
+        return 0;
+    }
+
+    // Signals are for the main thread, whose poll() they interrupt
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&notifier->thread, NULL, chat_notifier_main, notifier);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        perror("pthread_create failed");
+        close(notifier->efd);
+        return 0;
+    }
+    return 1;
+}
+
+void chat_notifier_stop(struct chat_notifier* notifier) {
+    atomic_store(&notifier->stop, 1);
+    // Kick the thread out of FUTEX_WAIT regardless of the counter value
+    futex_wake(&notifier->shm->published, INT_MAX);
+    pthread_join(notifier->thread, NULL);
+    close(notifier->efd);
+}
+
@@ -0,0 +1,153 @@
+#ifndef CHAT_SEARCH_H
+#define CHAT_SEARCH_H
+
+#include "config.h"
+#include "chat_journal.h"
+#include <stdint.h>
+#include <string.h>
+
+// Full-text index over the journal.
+//
+// chat_history.jnl.search is an append-only file of segments. Each segment
+// indexes one contiguous byte range of the journal: a table of term hashes
+// sorted by hash, each pointing at an ascending run of record offsets. The
+// journal is indexed once a range reaches CHAT_SEARCH_SEGMENT_BYTES;
+// searches scan the shorter unindexed tail directly. Segments end with a
+// copy of their length, like journal records, so a torn append is detected
+// and cut off by the next writer. Terms are runs of ASCII letters and
+// digits (case-folded) and UTF-8 sequences; only their 64-bit hashes are
+// stored.
+
+#define SEARCH_INDEX_FILE "chat_history.jnl.search"
+#define SEARCH_MAGIC      0x58444E49u  // "INDX"
+#define SEARCH_MAX_TERMS  16
+
+struct search_segment {
+    uint32_t magic;
+    uint32_t length;          // Whole segment: header, terms, postings, padding, trailer
+    uint64_t journal_start;   // Journal bytes [start, end) are indexed here
+    uint64_t journal_end;
+    uint32_t term_count;
+    uint32_t posting_count;
+    // struct search_term terms[term_count], uint32_t postings[posting_count],
+    // zero padding to 8 bytes, uint32_t length
+};
+
+struct search_term {
+    uint64_t hash;
+    uint32_t first;  // Index of the term's first posting
+    uint32_t count;
+};
+
+// A read-only, memory-mapped view of the index
+struct search_view {
+    const char* base;
+    size_t size;
+    uint64_t valid_end;     // End of the last complete segment
+    uint64_t journal_end;   // Journal bytes indexed so far
+};
+
+// In 64 bits, so the counts of a damaged segment cannot wrap it into a
+// plausible length
+static inline uint64_t search_segment_size(uint64_t term_count, uint64_t posting_count) {
+    uint64_t body = sizeof(struct search_segment) + term_count * sizeof(struct search_term) +
+                    posting_count * sizeof(uint32_t) + sizeof(uint32_t);
+    return (body + 7) & ~(uint64_t)7;
+}
+
+static inline const struct search_term* search_terms(const struct search_segment* seg) {
+    return (const struct search_term*)(seg + 1);
+}
+
+// Record offsets, relative to journal_start
+static inline const uint32_t* search_postings(const struct search_segment* seg) {
+    return (const uint32_t*)(search_terms(seg) + seg->term_count);
+}
+
+static inline int search_word_byte(unsigned char c) {
+    return c >= 0x80 || (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+// Find the next term in s starting at *pos and hash it (FNV-1a over the
+// case-folded bytes). Returns 0 when there are no more.
+static inline int search_next_term(const char* s, size_t len, size_t* pos, uint64_t* hash) {
+    size_t i = *pos;
+    while (i < len && !search_word_byte((unsigned char)s[i])) {
+        i++;
+    }
+    if (i == len) {
+        *pos = i;
+        return 0;
+    }
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (; i < len && search_word_byte((unsigned char)s[i]); i++) {
+        unsigned char c = (unsigned char)s[i];
+        h = (h ^ (c < 0x80 && c >= 'A' && c <= 'Z' ? c | 0x20 : c)) * 0x100000001b3ull;
+    }
+    *pos = i;
+    *hash = h;
+    return 1;
+}
+
+// Return the segment starting at offset, or NULL if there is no complete,
+// well-formed segment there
+static inline const struct search_segment* search_segment_at(const struct search_view* view,
+                                                             uint64_t offset) {
+    if (offset + sizeof(struct search_segment) + sizeof(uint32_t) > view->size) {
+        return NULL;
+    }
+    const struct search_segment* seg = (const struct search_segment*)(view->base + offset);
+    if (seg->magic != SEARCH_MAGIC || seg->length > view->size - offset ||
+        seg->length != search_segment_size(seg->term_count, seg->posting_count) ||
+        seg->journal_end < seg->journal_start) {
+        return NULL;
+    }
+    uint32_t trailer;
+    memcpy(&trailer, view->base + offset + seg->length - sizeof(uint32_t), sizeof(trailer));
+    return trailer == seg->length ? seg : NULL;
+}
+
+// Map the index and find where its complete segments end. A missing or
+// empty index is an empty view, not an error.
+static inline void search_open(struct search_view* view, const char* path) {
+    memset(view, 0, sizeof(*view));
+    view->base = journal_map(path, &view->size);
+
+    const struct search_segment* seg;
+    while (view->base && (seg = search_segment_at(view, view->valid_end)) != NULL) {
+        view->journal_end = seg->journal_end;
+        view->valid_end += seg->length;
+    }
+}
+
+static inline void search_close(struct search_view* view) {
+    if (view->base) {
+        munmap((void*)view->base, view->size);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+// The posting run for hash in this segment, or NULL if the term is absent
+// (or its run does not fit the segment's postings)
+static inline const uint32_t* search_lookup(const struct search_segment* seg, uint64_t hash,
+                                            uint32_t* count) {
+    const struct search_term* terms = search_terms(seg);
+    size_t lo = 0, hi = seg->term_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (terms[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == seg->term_count || terms[lo].hash != hash ||
+        (uint64_t)terms[lo].first + terms[lo].count > seg->posting_count) {
+        return NULL;
+    }
+    *count = terms[lo].count;
+    return search_postings(seg) + terms[lo].first;
+}
+
+#endif
@@ -0,0 +1,473 @@
+/*
+ * chat_segment.c
+ * OS Chat System - shared-memory backends
+ * Creating, finding, mapping and removing the room segment: SysV shm, a
+ * POSIX shm_open() object or a memfd, sized at runtime and optionally
+ * backed by huge pages and locked in RAM. Named channels are found by keys
+ * and names derived from the channel name.
+ */
+
+#define _GNU_SOURCE
+#include "chat_common.h"
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define ROOM_HUGE_PAGE (2 * 1024 * 1024)
+
+struct room_config room_config = {
+    .backend = ROOM_SHM_SYSV,
+    .ring_capacity = CHAT_RING_CAPACITY,
+    .arena_size = CHAT_ARENA_SIZE,
+};
+
+static const char* const backend_names[] = {"sysv", "posix", "memfd"};
+
+const char* room_backend_name(int backend) {
+    return backend >= 0 && backend <= ROOM_SHM_MEMFD ? backend_names[backend] : "?";
+}
+
+void room_config_usage(void) {
+    printf("  --shm sysv|posix|memfd  where the room's shared memory lives (default %s)\n",
+           room_backend_name(room_config.backend));
+    printf("  --ring-slots N          ring slots of a new room, a power of two (default %u)\n",
+           room_config.ring_capacity);
+    printf("  --arena-size SIZE       message arena of a new room, such as 64M (default %lluK)\n",
+           (unsigned long long)room_config.arena_size / 1024);
+    printf("  --hugepages             back the segment with huge pages\n");
+    printf("  --mlock                 lock the segment in RAM, faulting it in up front\n");
+}
+
+// A byte count with an optional K, M or G suffix
+static int parse_size(const char* text, uint64_t* out) {
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-') {
+        return 0;
+    }
+    switch (*end) {
+    case 'G': case 'g':
+        value <<= 10;
+        /* fall through */
+    case 'M': case 'm':
+        value <<= 10;
+        /* fall through */
+    case 'K': case 'k':
+        value <<= 10;
+        end++;
+        break;
+    default:
+        break;
+    }
+    *out = value;
+    return *end == '\0';
+}
+
+// Take the segment options out of argv, leaving the program's own arguments
+// in order for its usual parsing. Returns 0 after printing an error if one
+// has a bad value.
+int room_config_parse(int* argc, char** argv) {
+    int kept = 1;
+
+    for (int i = 1; i < *argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--hugepages") == 0) {
+            room_config.hugepages = 1;
+            continue;
+        }
+        if (strcmp(arg, "--mlock") == 0) {
+            room_config.lock_memory = 1;
+            continue;
+        }
+        if (strcmp(arg, "--shm") != 0 && strcmp(arg, "--ring-slots") != 0 &&
+            strcmp(arg, "--arena-size") != 0) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (i + 1 == *argc) {
+            printf("%s%s needs a value.%s\n", ERROR_COLOR, arg, COLOR_RESET);
+            return 0;
+        }
+        const char* value = argv[++i];
+        uint64_t n;
+
+        if (strcmp(arg, "--shm") == 0) {
+            int backend = -1;
+            for (int b = 0; b <= ROOM_SHM_MEMFD; b++) {
+                if (strcmp(value, backend_names[b]) == 0) {
+                    backend = b;
+                }
+            }
+            if (backend == -1) {
+                printf("%s--shm must be sysv, posix or memfd.%s\n", ERROR_COLOR, COLOR_RESET);
+                return 0;
+            }
+            room_config.backend = backend;
+        } else if (strcmp(arg, "--ring-slots") == 0) {
+            if (!parse_size(value, &n) || n < RING_MIN_SLOTS || n > RING_MAX_SLOTS || (n & (n - 1)) != 0) {
+                printf("%s--ring-slots must be a power of two from %d to %u.%s\n",
+                       ERROR_COLOR, RING_MIN_SLOTS, RING_MAX_SLOTS, COLOR_RESET);
+                return 0;
+            }
+            room_config.ring_capacity = (uint32_t)n;
+        } else {
+            if (!parse_size(value, &n) || n < ARENA_MIN_SIZE || n > ARENA_MAX_SIZE) {
+                printf("%s--arena-size must be from %lluK to %lluG.%s\n", ERROR_COLOR,
+                       (unsigned long long)ARENA_MIN_SIZE >> 10, (unsigned long long)ARENA_MAX_SIZE >> 30,
+                       COLOR_RESET);
+                return 0;
+            }
+            room_config.arena_size = n;
+        }
+    }
+    *argc = kept;
+    argv[kept] = NULL;
+    return 1;
+}
+
+/* ---- Layout ---- */
+
+static uint64_t room_arena_offset(uint32_t ring_capacity) {
+    uint64_t end = offsetof(struct shmseg, slots) + (uint64_t)ring_capacity * sizeof(struct chat_slot);
+    return (end + CHAT_CACHE_LINE - 1) & ~(uint64_t)(CHAT_CACHE_LINE - 1);
+}
+
+// Bytes a room with these sizes needs
+size_t room_layout_size(uint32_t ring_capacity, uint64_t arena_size) {
+    return (size_t)(room_arena_offset(ring_capacity) + arena_size);
+}
+
+// Record the layout in a fresh, zero-filled segment. Zero is already an
+// empty ring and an empty arena, so this is all the setup it needs.
+void room_format(struct shmseg* shm, uint32_t ring_capacity, uint64_t arena_size) {
+    shm->header.layout_version = ROOM_LAYOUT_VERSION;
+    shm->header.layout_size = sizeof(struct shmseg);
+    shm->header.ring_capacity = ring_capacity;
+    shm->header.ring_mask = ring_capacity - 1;
+    shm->header.arena_size = arena_size;
+    shm->header.arena_offset = room_arena_offset(ring_capacity);
+    shm->header.segment_size = room_layout_size(ring_capacity, arena_size);
+}
+
+// Whether a segment was laid out by a compatible build and its recorded
+// sizes fit the mapped bytes, so indexing by them stays inside the mapping
+int room_layout_valid(const struct shmseg* shm, size_t mapped) {
+    const struct room_header* h = &shm->header;
+    if (mapped < sizeof(struct shmseg) || atomic_load(&h->magic) != ROOM_MAGIC ||
+        h->layout_version != ROOM_LAYOUT_VERSION || h->layout_size != sizeof(struct shmseg)) {
+        return 0;
+    }
+    uint32_t ring = h->ring_capacity;
+    return ring >= RING_MIN_SLOTS && ring <= RING_MAX_SLOTS && (ring & (ring - 1)) == 0 &&
+           h->ring_mask == ring - 1 && h->arena_size >= ARENA_MIN_SIZE && h->arena_size <= ARENA_MAX_SIZE &&
+           h->arena_offset == room_arena_offset(ring) &&
+           h->segment_size == room_layout_size(ring, h->arena_size) && h->segment_size <= mapped;
+}
+
+/* ---- Mapping ---- */
+
+static size_t room_map_size(size_t size) {
+    size_t unit = room_config.hugepages ? ROOM_HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    return (size + unit - 1) / unit * unit;
+}
+
+/* ---- Channels ---- */
+
+// Channel names are 1 to CHAT_CHANNEL_NAME_MAX - 1 lowercase letters,
+// digits, '-' or '_', so they can go straight into a POSIX name
+int room_channel_valid(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= CHAT_CHANNEL_NAME_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The SysV key of a channel's segment or semaphore: base itself for the
+// main room, else base with a hash of the name in bits 16-30, which keeps
+// it positive and apart from every other channel's but for a 1 in 32767
+// collision that room_attach() detects through the header
+key_t room_channel_key(key_t base, const char* channel) {
+    if (!channel || channel[0] == '\0') {
+        return base;
+    }
+    uint32_t hash = 2166136261u;
+    for (const char* p = channel; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return (key_t)(((hash % 0x7fffu) + 1) << 16 | ((uint32_t)base & 0xffffu));
+}
+
+static void room_segment_name(char* name, size_t len, const char* channel, int shared) {
+    if (!shared) {
+        snprintf(name, len, "/chat-%x-%d", SHM_KEY, (int)getpid());
+    } else if (channel[0] != '\0') {
+        snprintf(name, len, "/chat-%x.%s", SHM_KEY, channel);
+    } else {
+        snprintf(name, len, "/chat-%x", SHM_KEY);
+    }
+}
+
+static void segment_reset(struct room_segment* seg, const char* channel) {
+    memset(seg, 0, sizeof(*seg));
+    seg->backend = room_config.backend;
+    seg->shmid = -1;
+    seg->fd = -1;
+    if (channel) {
+        snprintf(seg->channel, sizeof(seg->channel), "%s", channel);
+    }
+}
+
+// Ask for transparent huge pages where hugetlb was not available, and lock
+// the mapping if configured. Neither is fatal: the room works without.
+static void segment_tune(struct room_segment* seg, int readonly) {
+    static int warned;
+
+    if (room_config.hugepages && seg->pages != ROOM_PAGES_HUGETLB &&
+        madvise(seg->shm, seg->size, MADV_HUGEPAGE) == 0) {
+        seg->pages = ROOM_PAGES_THP;
+    }
+    if (room_config.lock_memory && !readonly) {
+        if (mlock(seg->shm, seg->size) == 0) {
+            seg->locked = 1;
+        } else if (!warned) {
+            printf("%sCould not lock the room in memory (%s); raise 'ulimit -l' for --mlock.%s\n",
+                   ERROR_COLOR, strerror(errno), COLOR_RESET);
+            warned = 1;
+        }
+    }
+}
+
+static int segment_mmap(struct room_segment* seg, int readonly) {
+    int flags = MAP_SHARED | (room_config.lock_memory && !readonly ? MAP_POPULATE : 0);
+    void* base = mmap(NULL, seg->size, PROT_READ | (readonly ? 0 : PROT_WRITE), flags, seg->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap failed");
+        return 0;
+    }
+    seg->shm = base;
+    segment_tune(seg, readonly);
+    return 1;
+}
+
+// Try a memfd on hugetlb pages. Creating one succeeds even when no huge
+// pages are reserved, so it only counts once the mapping is in place.
+static int segment_memfd_hugetlb(struct room_segment* seg) {
+    seg->fd = memfd_create("chat-room", MFD_CLOEXEC | MFD_HUGETLB);
+    if (seg->fd == -1) {
+        return 0;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(seg->fd, (off_t)seg->size) == 0) {
+        base = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, seg->fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        close(seg->fd);
+        seg->fd = -1;
+        return 0;
+    }
+    seg->shm = base;
+    seg->pages = ROOM_PAGES_HUGETLB;
+    segment_tune(seg, 0);
+    return 1;
+}
+
+// Create a segment for a new room, sized by room_config. A shared one can
+// be found by name by other processes (channel "" or NULL is the main
+// room); a private one is only shared with children forked after this.
+// Returns 1 when created, 0 if a shared one already exists and -1 on
+// failure.
+int segment_create(struct room_segment* seg, const char* channel, int shared) {
+    segment_reset(seg, channel);
+    seg->size = room_map_size(room_layout_size(room_config.ring_capacity, room_config.arena_size));
+
+    if (seg->backend == ROOM_SHM_SYSV) {
+        key_t key = shared ? room_channel_key(SHM_KEY, seg->channel) : IPC_PRIVATE;
+        int flags = IPC_CREAT | IPC_EXCL | (shared ? 0666 : 0600);
+        if (room_config.hugepages) {
+            seg->shmid = shmget(key, seg->size, flags | SHM_HUGETLB);
+            seg->pages = seg->shmid != -1 ? ROOM_PAGES_HUGETLB : ROOM_PAGES_NORMAL;
+        }
+        if (seg->shmid == -1) {
+            seg->shmid = shmget(key, seg->size, flags);
+        }
+        if (seg->shmid == -1) {
+            if (errno == EEXIST && shared) {
+                return 0;
+            }
+            perror("shmget failed");
+            printf("%sShared memory key: 0x%x, Size: %zu%s\n", ERROR_COLOR, key, seg->size, COLOR_RESET);
+            return -1;
+        }
+        seg->shm = shmat(seg->shmid, NULL, 0);
+        if (seg->shm == (void*)-1) {
+            perror("shmat failed");
+            seg->shm = NULL;
+            shmctl(seg->shmid, IPC_RMID, NULL);
+            return -1;
+        }
+        segment_tune(seg, 0);
+        return 1;
+    }
+
+    if (seg->backend == ROOM_SHM_MEMFD) {
+        if (shared) {
+            printf("%smemfd segments have no name other members could find; use --shm posix or sysv.%s\n",
+                   ERROR_COLOR, COLOR_RESET);
+            return -1;
+        }
+        if (room_config.hugepages && segment_memfd_hugetlb(seg)) {
+            return 1;
+        }
+        if (seg->fd == -1) {
+            seg->fd = memfd_create("chat-room", MFD_CLOEXEC);
+        }
+        if (seg->fd == -1) {
+            perror("memfd_create failed");
+            return -1;
+        }
+    } else {
+        room_segment_name(seg->name, sizeof(seg->name), seg->channel, shared);
+        seg->fd = shm_open(seg->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, shared ? 0666 : 0600);
+        if (seg->fd == -1) {
+            if (errno == EEXIST && shared) {
+                return 0;
+            }
+            perror("shm_open failed");
+            return -1;
+        }
+        // Held while attached, so a stale room is only replaced by its
+        // last user (see segment_sole_user)
+        flock(seg->fd, LOCK_SH);
+    }
+
+    int sized = ftruncate(seg->fd, (off_t)seg->size) == 0;
+    if (!sized) {
+        perror("ftruncate failed");
+    }
+    if (!sized || !segment_mmap(seg, 0)) {
+        segment_remove(seg);
+        segment_detach(seg);
+        return -1;
+    }
+    if (!shared && seg->name[0] != '\0') {
+        // Private: the mapping is all the children need
+        shm_unlink(seg->name);
+        seg->name[0] = '\0';
+    }
+    return 1;
+}
+
+// Map the existing shared segment of the configured backend for a channel
+// ("" or NULL for the main room). Returns 1 if there is one, with seg->shm
+// NULL if it is too small to be a room, 0 if there is none and -1 on
+// failure.
+int segment_open(struct room_segment* seg, const char* channel, int readonly) {
+    segment_reset(seg, channel);
+
+    if (seg->backend == ROOM_SHM_SYSV) {
+        struct shmid_ds ds;
+        seg->shmid = shmget(room_channel_key(SHM_KEY, seg->channel), 0, 0);
+        if (seg->shmid == -1) {
+            if (errno == ENOENT) {
+                return 0;
+            }
+            perror("shmget failed");
+            return -1;
+        }
+        if (shmctl(seg->shmid, IPC_STAT, &ds) == -1) {
+            perror("shmctl failed");
+            return -1;
+        }
+        seg->size = ds.shm_segsz;
+        if (seg->size < sizeof(struct shmseg)) {
+            return 1;
+        }
+        seg->shm = shmat(seg->shmid, NULL, readonly ? SHM_RDONLY : 0);
+        if (seg->shm == (void*)-1) {
+            perror("shmat failed");
+            printf("%sFailed to attach to shared memory ID: %d%s\n", ERROR_COLOR, seg->shmid, COLOR_RESET);
+            seg->shm = NULL;
+            return -1;
+        }
+        segment_tune(seg, readonly);
+        return 1;
+    }
+
+    if (seg->backend == ROOM_SHM_MEMFD) {
+        return 0;  // Never findable by name
+    }
+
+    room_segment_name(seg->name, sizeof(seg->name), seg->channel, 1);
+    seg->fd = shm_open(seg->name, (readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC, 0);
+    if (seg->fd == -1) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("shm_open failed");
+        return -1;
+    }
+    flock(seg->fd, LOCK_SH);
+
+    // The creator sizes the object right after creating it
+    struct stat st;
+    struct timespec step = {0, 10 * 1000000L};
+    for (int waited = 0; ; waited += 10) {
+        if (fstat(seg->fd, &st) == -1) {
+            perror("fstat failed");
+            return -1;
+        }
+        if ((size_t)st.st_size >= sizeof(struct shmseg) || waited >= CHAT_ATTACH_TIMEOUT_MS) {
+            break;
+        }
+        nanosleep(&step, NULL);
+    }
+    seg->size = (size_t)st.st_size;
+    if (seg->size < sizeof(struct shmseg)) {
+        return 1;
+    }
+    return segment_mmap(seg, readonly) ? 1 : -1;
+}
+
+// Whether nobody but us has the segment attached, so it may be replaced
+int segment_sole_user(struct room_segment* seg) {
+    if (seg->backend == ROOM_SHM_SYSV) {
+        struct shmid_ds ds;
+        if (shmctl(seg->shmid, IPC_STAT, &ds) == -1) {
+            return 0;
+        }
+        return (int)ds.shm_nattch - (seg->shm ? 1 : 0) == 0;
+    }
+    // Every member holds a shared lock; only a lone one can make it exclusive
+    return seg->fd == -1 || flock(seg->fd, LOCK_EX | LOCK_NB) == 0;
+}
+
+void segment_detach(struct room_segment* seg) {
+    if (seg->shm) {
+        if (seg->backend == ROOM_SHM_SYSV) {
+            shmdt(seg->shm);
+        } else {
+            munmap(seg->shm, seg->size);
+        }
+        seg->shm = NULL;
+    }
+    if (seg->fd != -1) {
+        close(seg->fd);
+        seg->fd = -1;
+    }
+}
+
+// Remove the segment's name; the memory goes once the last mapping does
+void segment_remove(struct room_segment* seg) {
+    if (seg->backend == ROOM_SHM_SYSV && seg->shmid != -1) {
+        shmctl(seg->shmid, IPC_RMID, NULL);
+    } else if (seg->name[0] != '\0') {
+        shm_unlink(seg->name);
+    }
+}
@@ -0,0 +1,317 @@
+/*
+ * chat_session.c
+ * OS Chat System - session API
+ * ChatSession wraps one membership of the room behind open / send / recv /
+ * poll fd / close, for bots and tools that do not want the terminal client.
+ */
+
+#include "chat_common.h"
+
+// Absolute CLOCK_MONOTONIC deadline for a millisecond timeout (< 0 = none)
+static void session_deadline(struct timespec* deadline, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    if (timeout_ms > 0) {
+        deadline->tv_sec += timeout_ms / 1000;
+        deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline->tv_nsec >= 1000000000L) {
+            deadline->tv_sec++;
+            deadline->tv_nsec -= 1000000000L;
+        }
+    }
+}
+
+// Relative time left until the deadline, as the futex helpers take it.
+// Returns 0 once the deadline has passed.
+static int session_time_left(const struct timespec* deadline, struct timespec* left) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left->tv_sec = deadline->tv_sec - now.tv_sec;
+    left->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (left->tv_nsec < 0) {
+        left->tv_sec--;
+        left->tv_nsec += 1000000000L;
+    }
+    return left->tv_sec >= 0;
+}
+
+// Consume our own messages at the cursor: chat_recv() would skip them
+// anyway, and a member that only ever sends must not hold the ring full
+// with them. A message handed out by chat_recv() is left alone. Returns 1
+// if the cursor moved.
+static int session_skip_own(ChatSession* session) {
+    struct chat_message msg;
+    int moved = 0;
+
+    while (!session->pending && room_read(session->shm, session->me, &msg) &&
+           msg.sender_id == session->me->id) {
+        room_advance(session->shm, session->me);
+        moved = 1;
+    }
+    return moved;
+}
+
+// Initialize chat session with user identity and default state
+void chat_session_init(ChatSession* session, const char* username, const char* color) {
+    memset(session, 0, sizeof(ChatSession));
+    strncpy(session->username, username, MAX_USERNAME_LEN - 1);
+    session->color = color;
+    session->segment.shmid = -1;
+    session->segment.fd = -1;
+    session->semid = -1;
+    session->shm = NULL;
+    session->index = -1;
+}
+
+//Clean up session resources: detach shared memory and reset state
+void chat_session_cleanup(ChatSession* session) {
+    segment_detach(&session->segment);
+    session->shm = NULL;
+    // Note: IPC removal is handled by cleanup_resources
+    session->semid = -1;
+    session->index = -1;
+    session->me = NULL;
+}
+
+// Attach to the main room (creating it if needed) and join as username.
+// Returns 1 on success.
+int chat_open(ChatSession* session, const char* username) {
+    return chat_open_channel(session, username, "");
+}
+
+// Join a named channel instead, a room of its own (see room_channel_key()).
+// One process may hold sessions in several channels at once.
+int chat_open_channel(ChatSession* session, const char* username, const char* channel) {
+    chat_session_init(session, username, user_color(username));
+    if (username[0] == '\0' || strlen(username) >= MAX_USERNAME_LEN) {
+        printf("%sUsername must be 1-%d characters.%s\n", ERROR_COLOR, MAX_USERNAME_LEN - 1, COLOR_RESET);
+        return 0;
+    }
+    if (channel[0] != '\0' && !room_channel_valid(channel)) {
+        printf("%sChannel names are 1-%d lowercase letters, digits, '-' or '_'.%s\n", ERROR_COLOR,
+               CHAT_CHANNEL_NAME_MAX - 1, COLOR_RESET);
+        return 0;
+    }
+    if (!room_attach(&session->segment, channel, &session->semid)) {
+        return 0;
+    }
+    session->shm = session->segment.shm;
+
+    session->index = room_join(session->shm, session->semid, username, &session->resumed);
+    if (session->index == -1) {
+        printf("%sCannot join: the name '%s' is taken or the room is full (%d members).%s\n",
+               ERROR_COLOR, username, MAX_USERS, COLOR_RESET);
+        chat_session_cleanup(session);
+        return 0;
+    }
+    session->me = &session->shm->participants[session->index];
+    return 1;
+}
+
+// Publish one message, waiting up to timeout_ms (-1 = forever) for ring or
+// arena space. Returns the message ID, or 0 on timeout.
+uint32_t chat_send(ChatSession* session, const char* text, size_t length, int type, int timeout_ms) {
+    struct chat_outgoing msg = {text, length, type};
+    struct timespec deadline, left;
+    uint32_t id;
+
+    session_deadline(&deadline, timeout_ms);
+    while (1) {
+        uint32_t tail = atomic_load(&session->shm->tail);
+        if (room_publish_batch(session->shm, session->me, &msg, 1, &id)) {
+            break;
+        }
+        if (session_skip_own(session)) {
+            continue;
+        }
+        if (timeout_ms == 0 || (timeout_ms > 0 && !session_time_left(&deadline, &left))) {
+            return 0;
+        }
+        // Wake at least once a second: if a dead member is what pins the
+        // ring, nobody else will move the reclaim point for us
+        if (timeout_ms < 0 || left.tv_sec >= 1) {
+            left = (struct timespec){1, 0};
+        }
+        if (!room_wait_writable(session->shm, tail, &left)) {
+            room_recover(session->shm, session->semid);
+        }
+    }
+
+    stat_add(&session->me->sent, 1);
+    if (length > 0) {
+        journal_append(session->shm->epoch << 32 | id, type, session->username, text, length);
+    }
+    return id;
+}
+
+// Wait up to timeout_ms (-1 = forever, 0 = just check) for the next message
+// from another member. Returns 1 with msg filled in, 0 on timeout.
+// msg->content points into shared memory and stays valid until the next
+// chat_recv() or chat_close().
+int chat_recv(ChatSession* session, struct chat_message* msg, int timeout_ms) {
+    struct timespec deadline, left;
+
+    if (session->pending) {
+        room_advance(session->shm, session->me);
+        session->pending = 0;
+    }
+    if (session->notifier_running) {
+        // Re-arm the poll fd before looking, so a publish after this point
+        // makes it readable again
+        uint64_t count;
+        if (read(session->notifier.efd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            perror("eventfd read failed");
+        }
+    }
+
+    session_deadline(&deadline, timeout_ms);
+    while (1) {
+        uint32_t seen = atomic_load(&session->shm->published);
+        while (room_read(session->shm, session->me, msg)) {
+            if (msg->sender_id != session->me->id) {
+                session->pending = 1;
+                stat_add(&session->me->received, 1);
+                return 1;
+            }
+            room_advance(session->shm, session->me);
+        }
+        if (timeout_ms == 0 || (timeout_ms > 0 && !session_time_left(&deadline, &left))) {
+            return 0;
+        }
+        room_wait_published(session->shm, seen, timeout_ms < 0 ? NULL : &left);
+    }
+}
+
+// A descriptor that polls readable whenever something may have been
+// published; call chat_recv() with a zero timeout until it returns 0.
+// Returns -1 on failure.
+int chat_poll_fd(ChatSession* session) {
+    if (!session->notifier_running) {
+        if (!chat_notifier_start(&session->notifier, session->shm)) {
+            return -1;
+        }
+        session->notifier_running = 1;
+        // Start out readable: messages may be waiting from before the
+        // notifier existed, such as a resumed session's backlog
+        uint64_t one = 1;
+        if (write(session->notifier.efd, &one, sizeof(one)) != sizeof(one)) {
+            perror("eventfd write failed");
+        }
+    }
+    return session->notifier.efd;
+}
+
+// Leave the room and detach. The last member out removes the room.
+void chat_close(ChatSession* session) {
+    if (session->notifier_running) {
+        chat_notifier_stop(&session->notifier);
+        session->notifier_running = 0;
+    }
+    if (session->shm && session->index != -1 &&
+        room_leave(session->shm, session->semid, session->index) == 0) {
+        cleanup_resources(&session->segment, session->semid);
+    }
+    session->pending = 0;
+    chat_session_cleanup(session);
+}
+
+//Create a new message buffer with room for capacity messages before it grows
+MessageBuffer* buffer_create(size_t capacity) {
+    MessageBuffer* buffer = malloc(sizeof(MessageBuffer));
+    if (!buffer) return NULL;
+    
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    buffer->messages = malloc(sizeof(struct chat_message) * capacity);
+    if (!buffer->messages) {
+        free(buffer);
+        return NULL;
+    }
+    
+    buffer->capacity = capacity;
+    buffer->count = 0;
+    buffer->head = 0;
+    buffer->tail = 0;
+    buffer->bytes = 0;
+    return buffer;
+}
+
+//Destroy message buffer and free all resources
+void buffer_destroy(MessageBuffer* buffer) {
+    if (buffer) {
+        buffer_drop(buffer, buffer->count);
+        free(buffer->messages);
+        free(buffer);
+    }
+}
+
+// Double the ring, unwrapping it so the oldest message is first again
+static int buffer_grow(MessageBuffer* buffer) {
+    size_t capacity = buffer->capacity * 2;
+    struct chat_message* grown = malloc(sizeof(struct chat_message) * capacity);
+    if (!grown) {
+        return 0;
+    }
+    for (size_t i = 0; i < buffer->count; i++) {
+        grown[i] = buffer->messages[(buffer->head + i) % buffer->capacity];
+    }
+    free(buffer->messages);
+    buffer->messages = grown;
+    buffer->capacity = capacity;
+    buffer->head = 0;
+    buffer->tail = buffer->count;
+    return 1;
+}
+
+//Push a copy of a message (and of its content) to the buffer (circular)
+int buffer_push(MessageBuffer* buffer, const struct chat_message* msg) {
+    if (!buffer || !msg) {
+        return 0; // Failure
+    }
+    if (buffer->count == buffer->capacity && !buffer_grow(buffer)) {
+        return 0;
+    }
+    char* content = malloc(msg->length + 1);
+    if (!content) {
+        return 0;
+    }
+    memcpy(content, msg->content, msg->length);
+    content[msg->length] = '\0';
+
+    buffer->messages[buffer->tail] = *msg;
+    buffer->messages[buffer->tail].content = content;
+    buffer->tail = (buffer->tail + 1) % buffer->capacity;
+    buffer->count++;
+    buffer->bytes += msg->length;
+    return 1; // Success
+}
+
+//Pop the oldest message from the buffer (circular). Its content now
+//belongs to the caller, who frees it with free().
+int buffer_pop(MessageBuffer* buffer, struct chat_message* msg) {
+    if (!buffer || !msg || buffer->count == 0) {
+        return 0; // Failure
+    }
+    
+    *msg = buffer->messages[buffer->head];
+    buffer->head = (buffer->head + 1) % buffer->capacity;
+    buffer->count--;
+    buffer->bytes -= msg->length;
+    return 1; // Success
+}
+
+//The index-th oldest message, or NULL past the end
+const struct chat_message* buffer_peek(const MessageBuffer* buffer, size_t index) {
+    if (!buffer || index >= buffer->count) {
+        return NULL;
+    }
+    return &buffer->messages[(buffer->head + index) % buffer->capacity];
+}
+
+//Discard the count oldest messages and their content
+void buffer_drop(MessageBuffer* buffer, size_t count) {
+    struct chat_message msg;
+    while (count-- > 0 && buffer_pop(buffer, &msg)) {
+        free((void*)msg.content);
+    }
+}
@@ -0,0 +1,302 @@
+#ifndef CHAT_TEXT_H
+#define CHAT_TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define TEXT_HAVE_SSSE3 1
+#endif
+
+// Message text hygiene.
+//
+// Payloads end up on other members' terminals, so each one gets a single
+// pass before it is sent and again before it is shown. The pass checks that
+// the text is valid UTF-8 with no control characters, which could move the
+// cursor or recolor the terminal. On x86 CPUs with SSSE3 (checked at run
+// time) the whole check runs 16 bytes at a time, using the lookup-table
+// UTF-8 validation of Keiser and Lemire. Elsewhere SSE2 skips printable
+// ASCII and the rest goes through the scalar decoder. Either way, only text
+// that needs repair is decoded byte by byte. Repairs are made in place and
+// never change the length:
+//   - every byte of an invalid sequence becomes '?';
+//   - control characters become spaces (C0 except tab, DEL, and the
+//     two-byte C1 range, which some terminals treat as escapes).
+
+#define TEXT_OK      0
+#define TEXT_CONTROL 1
+#define TEXT_INVALID 2
+
+// Length of the run of printable ASCII at the start of s
+static inline size_t text_ascii_run(const char* s, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        // Signed compare: bytes >= 0x80 are negative, so they count as < ' '
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        int mask = _mm_movemask_epi8(bad);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c < 0x20 || c >= 0x7F) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Decode the character at s. Returns how many bytes it (or the damage)
+// spans and sets *kind to TEXT_OK, TEXT_CONTROL or TEXT_INVALID. An invalid
+// sequence is reported one byte at a time.
+static inline size_t text_char(const unsigned char* s, size_t avail, int* kind) {
+    unsigned char c = s[0];
+    unsigned char lo = 0x80, hi = 0xBF;  // Allowed range of the second byte
+    size_t n;
+
+    *kind = TEXT_OK;
+    if (c < 0x80) {
+        if ((c < 0x20 && c != '\t') || c == 0x7F) {
+            *kind = TEXT_CONTROL;
+        }
+        return 1;
+    }
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) {
+            lo = 0xA0;  // Overlong
+        } else if (c == 0xED) {
+            hi = 0x9F;  // UTF-16 surrogates
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) {
+            lo = 0x90;  // Overlong
+        } else if (c == 0xF4) {
+            hi = 0x8F;  // Past U+10FFFF
+        }
+    } else {
+        *kind = TEXT_INVALID;
+        return 1;
+    }
+
+    if (avail < n || s[1] < lo || s[1] > hi) {
+        *kind = TEXT_INVALID;
+        return 1;
+    }
+    for (size_t i = 2; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *kind = TEXT_INVALID;
+            return 1;
+        }
+    }
+    if (c == 0xC2 && s[1] <= 0x9F) {
+        *kind = TEXT_CONTROL;  // U+0080..U+009F
+    }
+    return n;
+}
+
+// Length of the prefix of s that needs no repair (len if s is clean)
+static inline size_t text_clean_prefix_scalar(const char* s, size_t len) {
+    size_t i = 0;
+    while (1) {
+        i += text_ascii_run(s + i, len - i);
+        if (i == len) {
+            return len;
+        }
+        int kind;
+        size_t n = text_char((const unsigned char*)s + i, len - i, &kind);
+        if (kind != TEXT_OK) {
+            return i;
+        }
+        i += n;
+    }
+}
+
+#ifdef TEXT_HAVE_SSSE3
+// Error bits of the lookup-table validator. Each table maps a nibble of the
+// previous byte (high, low) or the current byte (high) to the errors that
+// nibble allows; a byte pair is bad if all three agree on some bit.
+#define TEXT_TOO_SHORT  (1 << 0)  // Lead byte not followed by a continuation
+#define TEXT_TOO_LONG   (1 << 1)  // ASCII followed by a continuation
+#define TEXT_OVERLONG_3 (1 << 2)
+#define TEXT_TOO_LARGE  (1 << 3)
+#define TEXT_SURROGATE  (1 << 4)
+#define TEXT_OVERLONG_2 (1 << 5)
+#define TEXT_TOO_LARGE_1000 (1 << 6)
+#define TEXT_OVERLONG_4 (1 << 6)
+#define TEXT_TWO_CONTS  (1 << 7)  // Continuation where a lead was needed
+#define TEXT_CARRY      (TEXT_TOO_SHORT | TEXT_TOO_LONG | TEXT_TWO_CONTS)
+
+// The last byte before position i that can start a character, for resuming
+// with the scalar decoder where a block of 16 reported a problem
+static inline size_t text_char_start(const char* s, size_t i) {
+    size_t j = i;
+    while (j > 0 && i - j < 3 && ((unsigned char)s[j - 1] & 0xC0) == 0x80) {
+        j--;
+    }
+    if (j > 0 && i - j < 4 && (unsigned char)s[j - 1] >= 0xC0) {
+        j--;
+    }
+    return j;
+}
+
+__attribute__((target("ssse3")))
+static inline size_t text_clean_prefix_ssse3(const char* s, size_t len) {
+    const __m128i byte_1_high = _mm_setr_epi8(
+        TEXT_TOO_LONG, TEXT_TOO_LONG, TEXT_TOO_LONG, TEXT_TOO_LONG,
+        TEXT_TOO_LONG, TEXT_TOO_LONG, TEXT_TOO_LONG, TEXT_TOO_LONG,
+        TEXT_TWO_CONTS, TEXT_TWO_CONTS, TEXT_TWO_CONTS, TEXT_TWO_CONTS,
+        TEXT_TOO_SHORT | TEXT_OVERLONG_2,
+        TEXT_TOO_SHORT,
+        TEXT_TOO_SHORT | TEXT_OVERLONG_3 | TEXT_SURROGATE,
+        TEXT_TOO_SHORT | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000 | TEXT_OVERLONG_4);
+    const __m128i byte_1_low = _mm_setr_epi8(
+        TEXT_CARRY | TEXT_OVERLONG_3 | TEXT_OVERLONG_2 | TEXT_OVERLONG_4,
+        TEXT_CARRY | TEXT_OVERLONG_2,
+        TEXT_CARRY,
+        TEXT_CARRY,
+        TEXT_CARRY | TEXT_TOO_LARGE,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000 | TEXT_SURROGATE,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000,
+        TEXT_CARRY | TEXT_TOO_LARGE | TEXT_TOO_LARGE_1000);
+    const __m128i byte_2_high = _mm_setr_epi8(
+        TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT,
+        TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT,
+        TEXT_TOO_LONG | TEXT_OVERLONG_2 | TEXT_TWO_CONTS | TEXT_OVERLONG_3 | TEXT_TOO_LARGE_1000 | TEXT_OVERLONG_4,
+        TEXT_TOO_LONG | TEXT_OVERLONG_2 | TEXT_TWO_CONTS | TEXT_OVERLONG_3 | TEXT_TOO_LARGE,
+        TEXT_TOO_LONG | TEXT_OVERLONG_2 | TEXT_TWO_CONTS | TEXT_SURROGATE | TEXT_TOO_LARGE,
+        TEXT_TOO_LONG | TEXT_OVERLONG_2 | TEXT_TWO_CONTS | TEXT_SURROGATE | TEXT_TOO_LARGE,
+        TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT, TEXT_TOO_SHORT);
+    // A lead byte this close to the end of a block needs the next block
+    const __m128i max_complete = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i prev = _mm_set1_epi8(' ');
+    int cut = 0;  // The previous block ended inside a character
+
+    for (size_t i = 0; i < len; i += 16) {
+        __m128i v;
+        if (len - i >= 16) {
+            v = _mm_loadu_si128((const __m128i*)(s + i));
+        } else {
+            // Pad the tail with spaces: valid, and not control characters
+            char tail[16];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, s + i, len - i);
+            v = _mm_loadu_si128((const __m128i*)tail);
+        }
+
+        __m128i error;
+        if (_mm_movemask_epi8(v) == 0) {
+            // All ASCII: only a sequence cut off by the previous block can be
+            // wrong, and printable text (the common case) takes one compare
+            error = cut ? _mm_set1_epi8(-1) : zero;
+            if (!cut && _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+                                                       _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)))) == 0) {
+                prev = v;
+                continue;
+            }
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(v, prev, 15);
+            __m128i special = _mm_and_si128(
+                _mm_and_si128(_mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                              _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+                _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+            // Third and fourth bytes of 3- and 4-byte sequences must be
+            // continuations, which the pair tables cannot see
+            __m128i third = _mm_subs_epu8(_mm_alignr_epi8(v, prev, 14), _mm_set1_epi8((char)(0xE0 - 1)));
+            __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(v, prev, 13), _mm_set1_epi8((char)(0xF0 - 1)));
+            __m128i must_continue = _mm_cmpgt_epi8(_mm_or_si128(third, fourth), zero);
+            error = _mm_xor_si128(_mm_and_si128(must_continue, _mm_set1_epi8((char)0x80)), special);
+            // C1 controls: C2 80..C2 9F
+            __m128i c1 = _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xC2)),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8((char)0x9F)), v));
+            error = _mm_or_si128(error, c1);
+            cut = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, max_complete), zero)) != 0xFFFF;
+        }
+        // C0 controls except tab, and DEL
+        __m128i c0 = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                      _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v));
+        error = _mm_or_si128(error, _mm_or_si128(c0, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F))));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) {
+            // Something in or just before this block: find it exactly
+            size_t j = text_char_start(s, i);
+            return j + text_clean_prefix_scalar(s + j, len - j);
+        }
+        prev = v;
+    }
+    if (cut) {
+        // The text ends inside a character
+        size_t j = text_char_start(s, len - (len % 16 ? len % 16 : 16));
+        return j + text_clean_prefix_scalar(s + j, len - j);
+    }
+    return len;
+}
+#endif
+
+// Length of the prefix of s that needs no repair (len if s is clean)
+static inline size_t text_clean_prefix(const char* s, size_t len) {
+#ifdef TEXT_HAVE_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+        return text_clean_prefix_ssse3(s, len);
+    }
+#endif
+    return text_clean_prefix_scalar(s, len);
+}
+
+// Repair s in place. Returns how many bytes were changed.
+static inline size_t text_sanitize(char* s, size_t len) {
+    size_t changed = 0;
+
+    for (size_t i = text_clean_prefix(s, len); i < len; i += text_clean_prefix(s + i, len - i)) {
+        int kind;
+        size_t n = text_char((const unsigned char*)s + i, len - i, &kind);
+        if (kind != TEXT_OK) {
+            memset(s + i, kind == TEXT_CONTROL ? ' ' : '?', n);
+            changed += n;
+        }
+        i += n;
+    }
+    return changed;
+}
+
+// Whether s equals word (lowercase ASCII letters) ignoring case. Folding
+// with | 0x20 only maps a byte onto a lowercase letter from that letter or
+// its uppercase form, so no copy or tolower() is needed.
+static inline int text_equals_folded(const char* s, size_t len, const char* word, size_t word_len) {
+    if (len != word_len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (((unsigned char)s[i] | 0x20) != (unsigned char)word[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * chat_trace.c
+ * OS Chat System - critical-section tracing
+ * Per-thread event buffers behind TRACE_EVENT(), switched on by CHAT_TRACE
+ * and written to the trace file in the chunk format of chat_trace.h.
+ */
+
+#include "chat_common.h"
+#include <sys/prctl.h>
+
+struct trace_pending {
+    uint64_t ns;
+    uint64_t arg;
+    const char* func;        // Sites are resolved to names when written out
+    uint32_t line;
+    uint16_t type;
+};
+
+struct trace_buffer {
+    struct trace_buffer* next;  // Every live thread's buffer, for the flush at exit
+    pid_t tid;
+    char thread[16];
+    uint32_t count;
+    struct trace_pending events[CHAT_TRACE_BUFFER_EVENTS];
+    char chunk[];               // Where a chunk is assembled for writing
+};
+
+#define TRACE_CHUNK_MAX trace_chunk_size(TRACE_MAX_SITES, CHAT_TRACE_BUFFER_EVENTS)
+
+int chat_trace_enabled;
+
+static int trace_fd = -1;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer* trace_buffers;
+static pthread_key_t trace_key;
+static __thread struct trace_buffer* trace_mine;
+
+// Write out a buffer's events as one chunk and empty it. Only the owning
+// thread records into a buffer, so this runs on that thread or at exit.
+static void trace_buffer_write(struct trace_buffer* buf) {
+    if (buf->count == 0) {
+        return;
+    }
+    struct trace_chunk* chunk = (struct trace_chunk*)buf->chunk;
+    struct trace_site* sites = (struct trace_site*)(chunk + 1);
+    const char* funcs[TRACE_MAX_SITES];
+    uint32_t site_count = 0;
+
+    // Resolve sites first: the records start after however many there are
+    for (uint32_t i = 0; i < buf->count; i++) {
+        const struct trace_pending* ev = &buf->events[i];
+        uint32_t s = 0;
+        while (s < site_count && (funcs[s] != ev->func || sites[s].line != ev->line)) {
+            s++;
+        }
+        if (s == site_count && site_count < TRACE_MAX_SITES) {
+            funcs[s] = ev->func;
+            memset(&sites[s], 0, sizeof(sites[s]));
+            sites[s].line = ev->line;
+            snprintf(sites[s].func, sizeof(sites[s].func), "%s", ev->func);
+            site_count++;
+        }
+    }
+
+    struct trace_record* records = (struct trace_record*)(sites + site_count);
+    uint32_t event_count = 0;
+    for (uint32_t i = 0; i < buf->count; i++) {
+        const struct trace_pending* ev = &buf->events[i];
+        uint32_t s = 0;
+        while (s < site_count && (funcs[s] != ev->func || sites[s].line != ev->line)) {
+            s++;
+        }
+        if (s == site_count) {
+            continue;  // Past TRACE_MAX_SITES distinct sites in one chunk
+        }
+        records[event_count++] = (struct trace_record){ev->ns, ev->arg, (uint16_t)s, ev->type, 0};
+    }
+    buf->count = 0;
+
+    uint64_t length = trace_chunk_size(site_count, event_count);
+    *chunk = (struct trace_chunk){
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .length = (uint32_t)length,
+        .pid = (int32_t)getpid(),
+        .tid = (int32_t)buf->tid,
+        .site_count = site_count,
+        .event_count = event_count,
+    };
+    memcpy(chunk->thread, buf->thread, sizeof(chunk->thread));
+    memcpy(buf->chunk + length - sizeof(uint64_t), &length, sizeof(uint64_t));
+
+    // One write, so chunks from concurrent writers never interleave
+    if (write(trace_fd, buf->chunk, length) != (ssize_t)length) {
+        chat_trace_enabled = 0;
+    }
+}
+
+static struct trace_buffer* trace_buffer_new(void) {
+    struct trace_buffer* buf = malloc(sizeof(*buf) + TRACE_CHUNK_MAX);
+    if (!buf) {
+        chat_trace_enabled = 0;
+        return NULL;
+    }
+    buf->tid = (pid_t)syscall(SYS_gettid);
+    buf->count = 0;
+    memset(buf->thread, 0, sizeof(buf->thread));
+    prctl(PR_GET_NAME, buf->thread);
+
+    pthread_mutex_lock(&trace_lock);
+    buf->next = trace_buffers;
+    trace_buffers = buf;
+    pthread_mutex_unlock(&trace_lock);
+    pthread_setspecific(trace_key, buf);
+    trace_mine = buf;
+    return buf;
+}
+
+void trace_event_at(int type, const char* func, int line, uint64_t arg) {
+    struct trace_buffer* buf = trace_mine;
+    if (!buf && !(buf = trace_buffer_new())) {
+        return;
+    }
+    buf->events[buf->count++] =
+        (struct trace_pending){chat_now_ns(), arg, func, (uint32_t)line, (uint16_t)type};
+    if (buf->count == CHAT_TRACE_BUFFER_EVENTS) {
+        uint64_t start = chat_now_ns();
+        trace_buffer_write(buf);
+        // So chattrace can tell the tracer's own stalls from the program's
+        trace_event_at(TRACE_FLUSH, __func__, __LINE__, chat_now_ns() - start);
+    }
+}
+
+// A thread that exits takes its buffer with it
+static void trace_thread_exit(void* arg) {
+    struct trace_buffer* buf = arg;
+
+    pthread_mutex_lock(&trace_lock);
+    trace_buffer_write(buf);
+    for (struct trace_buffer** p = &trace_buffers; *p; p = &(*p)->next) {
+        if (*p == buf) {
+            *p = buf->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+    free(buf);
+}
+
+// Write out every thread's buffer. Runs at exit; call it before _exit().
+void chat_trace_flush(void) {
+    if (!chat_trace_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    for (struct trace_buffer* buf = trace_buffers; buf; buf = buf->next) {
+        trace_buffer_write(buf);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_before_fork(void) {
+    pthread_mutex_lock(&trace_lock);
+}
+
+static void trace_after_fork_parent(void) {
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// The child's copies of the parent's events are the parent's to write, and
+// of the parent's threads only the forking one carries on here
+static void trace_after_fork_child(void) {
+    struct trace_buffer* buf = trace_buffers;
+    while (buf) {
+        struct trace_buffer* next = buf->next;
+        if (buf != trace_mine) {
+            free(buf);
+        }
+        buf = next;
+    }
+    trace_buffers = trace_mine;
+    if (trace_mine) {
+        trace_mine->next = NULL;
+        trace_mine->count = 0;
+        trace_mine->tid = (pid_t)syscall(SYS_gettid);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+__attribute__((constructor)) static void trace_start(void) {
+    const char* path = getenv("CHAT_TRACE");
+    if (!path || path[0] == '\0') {
+        return;
+    }
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd == -1) {
+        fprintf(stderr, "CHAT_TRACE: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (pthread_key_create(&trace_key, trace_thread_exit) != 0) {
+        close(trace_fd);
+        return;
+    }
+    pthread_atfork(trace_before_fork, trace_after_fork_parent, trace_after_fork_child);
+    // Registered before anything else, so it runs after every other
+    // handler has finished recording
+    atexit(chat_trace_flush);
+    chat_trace_enabled = 1;
+}
@@ -0,0 +1,112 @@
+#ifndef CHAT_TRACE_H
+#define CHAT_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Critical-section tracing.
+//
+// With CHAT_TRACE=<file> in the environment, every thread of every chat
+// process records timestamped events into a buffer of its own: semaphore 0
+// requested, acquired and released (under the name and line of the code
+// that took it), messages published and consumed, waits for ring space and
+// log lines queued. Recording takes no lock and no system call beyond
+// reading the clock. A full buffer is written to the file as one
+// self-contained chunk with a single O_APPEND write(), so any number of
+// processes can share a trace file; whatever is left is written at exit.
+// Without the variable each trace point costs one predictable branch.
+// chattrace reads the file back.
+//
+// A chunk on disk:
+//   struct trace_chunk
+//   site_count x struct trace_site      call sites its events refer to
+//   event_count x struct trace_record
+//   uint64_t length                     copy of chunk.length, to spot a
+//                                       torn chunk
+
+#define TRACE_MAGIC     0x45435254u  // "TRCE"
+#define TRACE_VERSION   1
+#define TRACE_FUNC_MAX  40
+#define TRACE_MAX_SITES 256
+
+enum trace_event_type {
+    TRACE_LOCK_REQUEST = 1,  // arg: semaphore ID
+    TRACE_LOCK_ACQUIRED,     // arg: semaphore ID
+    TRACE_LOCK_RELEASED,     // arg: semaphore ID
+    TRACE_LOCK_BUSY,         // A try-lock found it taken; arg: semaphore ID
+    TRACE_PUBLISH,           // arg: first message ID << 32 | count
+    TRACE_ROOM_FULL,         // A publish was refused; arg: 1 ring, 0 arena
+    TRACE_CONSUME,           // arg: message ID
+    TRACE_SPACE_WAIT,        // Blocked for ring space; arg: nanoseconds
+    TRACE_LOG,               // A log line was queued; arg: log sink
+    TRACE_FLUSH,             // This thread wrote its buffer; arg: nanoseconds
+    TRACE_EVENT_TYPES
+};
+
+struct trace_chunk {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t length;         // Bytes in the whole chunk, trailer included
+    int32_t pid;
+    int32_t tid;
+    uint32_t site_count;
+    uint32_t event_count;
+    uint32_t reserved;
+    char thread[16];         // Thread name, as in /proc/<pid>/comm
+};
+
+struct trace_site {
+    uint32_t line;
+    uint32_t reserved;
+    char func[TRACE_FUNC_MAX];
+};
+
+struct trace_record {
+    uint64_t ns;             // CLOCK_MONOTONIC, comparable across processes
+    uint64_t arg;
+    uint16_t site;           // Index into the chunk's sites
+    uint16_t type;
+    uint32_t reserved;
+};
+
+static inline uint64_t trace_chunk_size(uint32_t site_count, uint32_t event_count) {
+    return sizeof(struct trace_chunk) + (uint64_t)site_count * sizeof(struct trace_site) +
+           (uint64_t)event_count * sizeof(struct trace_record) + sizeof(uint64_t);
+}
+
+// The chunk at offset in a mapped trace file, or NULL if there is none or
+// it is torn
+static inline const struct trace_chunk* trace_chunk_at(const char* base, uint64_t size, uint64_t offset) {
+    const struct trace_chunk* chunk = (const struct trace_chunk*)(base + offset);
+    if (size - offset < sizeof(*chunk) || chunk->magic != TRACE_MAGIC || chunk->version != TRACE_VERSION ||
+        chunk->site_count > TRACE_MAX_SITES || chunk->length > size - offset ||
+        chunk->length != trace_chunk_size(chunk->site_count, chunk->event_count)) {
+        return NULL;
+    }
+    uint64_t trailer;
+    memcpy(&trailer, base + offset + chunk->length - sizeof(trailer), sizeof(trailer));
+    return trailer == chunk->length ? chunk : NULL;
+}
+
+static inline const struct trace_site* trace_chunk_sites(const struct trace_chunk* chunk) {
+    return (const struct trace_site*)(chunk + 1);
+}
+
+static inline const struct trace_record* trace_chunk_events(const struct trace_chunk* chunk) {
+    return (const struct trace_record*)(trace_chunk_sites(chunk) + chunk->site_count);
+}
+
+// Recording (chat_trace.c)
+extern int chat_trace_enabled;
+void trace_event_at(int type, const char* func, int line, uint64_t arg);
+void chat_trace_flush(void);
+
+// Record an event under the enclosing function's name and this line
+#define TRACE_EVENT(type, arg)                                   \
+    do {                                                         \
+        if (chat_trace_enabled) {                                \
+            trace_event_at((type), __func__, __LINE__, (arg));   \
+        }                                                        \
+    } while (0)
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef CHAT_WIRE_H
+#define CHAT_WIRE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+// chatd wire protocol.
+//
+// Socket clients talk to the gateway in frames: a 4-byte big-endian length
+// covering everything after it, a 1-byte frame type, then the payload.
+//
+//   client -> chatd   WIRE_HELLO    name                       (first frame)
+//                     WIRE_SEND     u8 type, text
+//   chatd -> client   WIRE_WELCOME  u32 sender_id, u32 room members
+//                     WIRE_MESSAGE  u32 message_id, u32 sender_id, u8 type,
+//                                   u8 sender_len, sender, text
+//                     WIRE_ERROR    text (the connection is closed after it)
+//
+// Every message published in the room is delivered, the client's own
+// included: a MESSAGE carrying the sender_id from WELCOME confirms the
+// client's send. Integers are big-endian. Text is UTF-8 and not
+// NUL-terminated.
+
+#define WIRE_HELLO   1
+#define WIRE_SEND    2
+#define WIRE_WELCOME 16
+#define WIRE_MESSAGE 17
+#define WIRE_ERROR   18
+
+#define WIRE_HEADER_SIZE   5
+#define WIRE_MESSAGE_FIXED 10  // WIRE_MESSAGE payload before the sender name
+#define WIRE_MAX_FRAME     (WIRE_HEADER_SIZE + WIRE_MESSAGE_FIXED + 255 + CHAT_MAX_PAYLOAD)
+
+static inline void wire_put32(char* p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static inline uint32_t wire_get32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+// Write a frame header for a payload of payload_len bytes
+static inline void wire_header(char* out, int type, size_t payload_len) {
+    wire_put32(out, (uint32_t)(payload_len + 1));
+    out[4] = (char)type;
+}
+
+// If buf starts with a complete frame, return its total size and point
+// *payload / *payload_len at its body. Returns 0 if more bytes are needed
+// and -1 if the length field is invalid.
+static inline long wire_frame(const char* buf, size_t len, int* type, const char** payload,
+                              size_t* payload_len) {
+    if (len < WIRE_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t body = wire_get32(buf);
+    if (body == 0 || body > WIRE_MAX_FRAME - 4) {
+        return -1;
+    }
+    if (len < 4 + (size_t)body) {
+        return 0;
+    }
+    *type = (unsigned char)buf[4];
+    *payload = buf + WIRE_HEADER_SIZE;
+    *payload_len = body - 1;
+    return 4 + (long)body;
+}
+
+// Size of a WIRE_MESSAGE frame for this sender and text
+static inline size_t wire_message_size(size_t sender_len, size_t text_len) {
+    return WIRE_HEADER_SIZE + WIRE_MESSAGE_FIXED + sender_len + text_len;
+}
+
+static inline size_t wire_encode_message(char* out, uint32_t message_id, uint32_t sender_id, int type,
+                                         const char* sender, size_t sender_len, const char* text,
+                                         size_t text_len) {
+    if (sender_len > 255) {
+        sender_len = 255;
+    }
+    size_t payload = WIRE_MESSAGE_FIXED + sender_len + text_len;
+    wire_header(out, WIRE_MESSAGE, payload);
+    char* p = out + WIRE_HEADER_SIZE;
+    wire_put32(p, message_id);
+    wire_put32(p + 4, sender_id);
+    p[8] = (char)type;
+    p[9] = (char)sender_len;
+    memcpy(p + WIRE_MESSAGE_FIXED, sender, sender_len);
+    memcpy(p + WIRE_MESSAGE_FIXED + sender_len, text, text_len);
+    return WIRE_HEADER_SIZE + payload;
+}
+
+#endif
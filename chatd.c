@@ -0,0 +1,692 @@
+/*
+ * chatd.c
+ * OS Chat System - socket gateway
+ * Joins the room as one member and bridges it to clients on a Unix socket
+ * and, optionally, loopback TCP, speaking the framing in chat_wire.h. One
+ * epoll loop does everything. Messages read from the ring are encoded once
+ * per batch into a shared chunk that every subscriber's write queue
+ * references, and sockets are only ever written outside the room lock.
+ */
+
+#define _GNU_SOURCE  // accept4()
+#include "chat_common.h"
+#include "chat_wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define GW_MAX_EVENTS  256
+#define GW_READ_SIZE   (64 * 1024)  // Bytes read from one client per event
+#define GW_CHUNK_SIZE  (64 * 1024)  // Ring messages are encoded into chunks of this size
+#define GW_IOV_MAX     64
+#define GW_RETRY_MS    10           // Recheck cadence while a publish waits for ring space
+#define GW_MAX_CLIENTS 16384
+
+// Encoded frames shared by every write queue they sit in
+struct gw_chunk {
+    uint32_t refs;
+    size_t len;
+    size_t cap;
+    char data[];
+};
+
+struct gw_conn {
+    int fd;
+    int joined;         // HELLO accepted: receives messages and may send
+    int blocked;        // A publish is waiting for ring space; reading is paused
+    uint32_t events;    // Events currently registered with epoll
+    size_t sub_index;   // Position in gateway.subs while joined
+    struct chat_participant ident;  // Sender ID and name; all room_publish_batch() reads
+
+    char* in;           // Received bytes; frames before in_pos are done
+    size_t in_pos, in_len, in_cap;
+
+    struct gw_chunk** queue;  // Circular queue of chunks still to write
+    size_t q_head, q_count, q_cap;
+    size_t q_off;       // Bytes of the head chunk already written
+    size_t queued;      // Bytes still to write
+};
+
+struct gateway {
+    ChatSession session;
+    int epfd;
+    int unix_fd, tcp_fd, event_fd;
+    const char* socket_path;
+
+    struct gw_conn** conns;  // Indexed by descriptor
+    size_t conns_cap;
+    struct gw_conn** subs;   // Joined connections
+    size_t nsubs;
+    size_t blocked;          // Connections waiting to publish
+
+    size_t chunk_bytes;      // Memory held by live chunks
+    int ring_paused;         // Stopped reading the ring until chunk_bytes falls
+    uint64_t delivered, published, dropped_slow;
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void signal_handler(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [-s socket_path] [-p tcp_port] [-n name]\n", prog);
+    printf("  -s socket_path: Unix socket to listen on (default: %s)\n", CHATD_SOCKET_PATH);
+    printf("  -p tcp_port:    also listen on 127.0.0.1:tcp_port\n");
+    printf("  -n name:        the gateway's member name in the room (default: chatd)\n");
+    printf("Room segment options:\n");
+    room_config_usage();
+}
+
+static struct gw_chunk* gw_chunk_new(struct gateway* gw, size_t cap) {
+    struct gw_chunk* chunk = malloc(sizeof(*chunk) + cap);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->refs = 1;
+    chunk->len = 0;
+    chunk->cap = cap;
+    gw->chunk_bytes += cap;
+    return chunk;
+}
+
+static void gw_chunk_put(struct gateway* gw, struct gw_chunk* chunk) {
+    if (--chunk->refs == 0) {
+        gw->chunk_bytes -= chunk->cap;
+        free(chunk);
+    }
+}
+
+// Register the events this connection currently wants: input unless a
+// publish is stuck, output only while something is queued
+static void gw_update_events(struct gateway* gw, struct gw_conn* conn) {
+    uint32_t want = (conn->blocked ? 0 : EPOLLIN) | (conn->q_count ? EPOLLOUT : 0);
+    if (want != conn->events) {
+        struct epoll_event ev = {.events = want, .data.fd = conn->fd};
+        epoll_ctl(gw->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = want;
+    }
+}
+
+static void gw_close(struct gateway* gw, struct gw_conn* conn, const char* reason) {
+    char event[128];
+
+    if (conn->joined) {
+        // Tell the room, best effort: a full ring is not worth waiting on
+        room_publish(gw->session.shm, &conn->ident, "", 0, MSG_TYPE_EXIT);
+        snprintf(event, sizeof(event), "chatd: %s disconnected%s%s", conn->ident.name,
+                 reason ? ": " : "", reason ? reason : "");
+        log_system_event(event);
+
+        struct gw_conn* last = gw->subs[--gw->nsubs];
+        gw->subs[conn->sub_index] = last;
+        last->sub_index = conn->sub_index;
+    }
+    if (conn->blocked) {
+        gw->blocked--;
+    }
+    for (size_t i = 0; i < conn->q_count; i++) {
+        gw_chunk_put(gw, conn->queue[(conn->q_head + i) % conn->q_cap]);
+    }
+    gw->conns[conn->fd] = NULL;
+    close(conn->fd);
+    free(conn->queue);
+    free(conn->in);
+    free(conn);
+}
+
+// Write as much of the queue as the socket takes. Returns 0 if the
+// connection failed and was closed.
+static int gw_flush(struct gateway* gw, struct gw_conn* conn) {
+    while (conn->q_count > 0) {
+        struct iovec iov[GW_IOV_MAX];
+        int n = 0;
+        for (size_t i = 0; i < conn->q_count && n < GW_IOV_MAX; i++, n++) {
+            struct gw_chunk* chunk = conn->queue[(conn->q_head + i) % conn->q_cap];
+            size_t off = i == 0 ? conn->q_off : 0;
+            iov[n].iov_base = chunk->data + off;
+            iov[n].iov_len = chunk->len - off;
+        }
+
+        ssize_t written = writev(conn->fd, iov, n);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            gw_close(gw, conn, strerror(errno));
+            return 0;
+        }
+
+        conn->queued -= (size_t)written;
+        size_t left = (size_t)written;
+        while (left > 0) {
+            struct gw_chunk* chunk = conn->queue[conn->q_head];
+            size_t rest = chunk->len - conn->q_off;
+            if (left < rest) {
+                conn->q_off += left;
+                break;
+            }
+            left -= rest;
+            conn->q_off = 0;
+            conn->q_head = (conn->q_head + 1) % conn->q_cap;
+            conn->q_count--;
+            gw_chunk_put(gw, chunk);
+        }
+    }
+    gw_update_events(gw, conn);
+    return 1;
+}
+
+// Append a chunk to the connection's queue. Returns 0 if the connection is
+// already too far behind to take it.
+static int gw_enqueue(struct gw_conn* conn, struct gw_chunk* chunk) {
+    if (conn->queued + chunk->len > CHATD_CONN_QUEUE_MAX) {
+        return 0;
+    }
+    if (conn->q_count == conn->q_cap) {
+        size_t cap = conn->q_cap ? conn->q_cap * 2 : 8;
+        struct gw_chunk** grown = malloc(cap * sizeof(*grown));
+        if (!grown) {
+            return 0;
+        }
+        for (size_t i = 0; i < conn->q_count; i++) {
+            grown[i] = conn->queue[(conn->q_head + i) % conn->q_cap];
+        }
+        free(conn->queue);
+        conn->queue = grown;
+        conn->q_head = 0;
+        conn->q_cap = cap;
+    }
+    conn->queue[(conn->q_head + conn->q_count) % conn->q_cap] = chunk;
+    conn->q_count++;
+    conn->queued += chunk->len;
+    chunk->refs++;
+    return 1;
+}
+
+// Queue a chunk to every subscriber and drop our reference. A subscriber
+// that had nothing queued is written to right away; one that is still
+// waiting for EPOLLOUT is left to it.
+static void gw_dispatch(struct gateway* gw, struct gw_chunk* chunk) {
+    // Backwards, so a subscriber closed here swaps in one already served
+    for (size_t i = gw->nsubs; i-- > 0;) {
+        struct gw_conn* conn = gw->subs[i];
+        if (!gw_enqueue(conn, chunk)) {
+            gw->dropped_slow++;
+            gw_close(gw, conn, "too slow, queue full");
+            continue;
+        }
+        if (conn->q_count == 1) {
+            gw_flush(gw, conn);
+        }
+    }
+    gw_chunk_put(gw, chunk);
+}
+
+// Move everything new in the ring out to the subscribers. Stops early once
+// the gateway holds too much unwritten data: the ring then fills and
+// publishers wait, instead of the gateway buffering without bound.
+static void gw_fanout(struct gateway* gw) {
+    struct shmseg* shm = gw->session.shm;
+    struct chat_participant* me = gw->session.me;
+    struct gw_chunk* chunk = NULL;
+    struct chat_message msg;
+    uint64_t count = 0;
+
+    while (!gw->ring_paused && room_read(shm, me, &msg)) {
+        if (gw->nsubs > 0 && msg.sender_id != me->id) {
+            size_t sender_len = strnlen(msg.sender, MAX_USERNAME_LEN);
+            size_t size = wire_message_size(sender_len, msg.length);
+            if (chunk && chunk->len + size > chunk->cap) {
+                gw_dispatch(gw, chunk);
+                chunk = NULL;
+            }
+            if (!chunk && !(chunk = gw_chunk_new(gw, size > GW_CHUNK_SIZE ? size : GW_CHUNK_SIZE))) {
+                break;
+            }
+            chunk->len += wire_encode_message(chunk->data + chunk->len, (uint32_t)msg.message_id,
+                                              msg.sender_id, msg.type, msg.sender, sender_len,
+                                              msg.content, msg.length);
+            count++;
+        }
+        room_advance(shm, me);
+        if (gw->chunk_bytes >= CHATD_MEMORY_HIGH_WATER) {
+            gw->ring_paused = 1;
+        }
+    }
+    if (chunk) {
+        gw_dispatch(gw, chunk);
+    }
+    if (count > 0) {
+        stat_add(&me->received, count);
+        gw->delivered += count;
+    }
+}
+
+// Queue one small frame of our own to a single connection. Returns 0 if
+// the connection was closed.
+static int gw_send_frame(struct gateway* gw, struct gw_conn* conn, int type, const char* payload,
+                         size_t length) {
+    struct gw_chunk* chunk = gw_chunk_new(gw, WIRE_HEADER_SIZE + length);
+    if (!chunk) {
+        return 0;
+    }
+    wire_header(chunk->data, type, length);
+    memcpy(chunk->data + WIRE_HEADER_SIZE, payload, length);
+    chunk->len = WIRE_HEADER_SIZE + length;
+    int queued = gw_enqueue(conn, chunk);
+    gw_chunk_put(gw, chunk);
+    if (!queued) {
+        gw_close(gw, conn, "out of memory");
+        return 0;
+    }
+    return gw_flush(gw, conn);
+}
+
+// Send an ERROR frame and hang up. Always returns 0.
+static int gw_reject(struct gateway* gw, struct gw_conn* conn, const char* reason) {
+    // One attempt: the socket is about to close either way
+    char frame[WIRE_HEADER_SIZE + 128];
+    size_t length = strnlen(reason, 128);
+    wire_header(frame, WIRE_ERROR, length);
+    memcpy(frame + WIRE_HEADER_SIZE, reason, length);
+    if (write(conn->fd, frame, WIRE_HEADER_SIZE + length) == -1) {
+        // Nothing more to do for a client we are dropping
+    }
+    gw_close(gw, conn, reason);
+    return 0;
+}
+
+static int gw_hello(struct gateway* gw, struct gw_conn* conn, const char* name, size_t length) {
+    struct shmseg* shm = gw->session.shm;
+    char event[MAX_USERNAME_LEN + 64];
+
+    if (length == 0 || length >= MAX_USERNAME_LEN || text_clean_prefix(name, length) != length) {
+        return gw_reject(gw, conn, "name must be 1-19 bytes of printable UTF-8");
+    }
+    memcpy(conn->ident.name, name, length);
+    conn->ident.name[length] = '\0';
+    // The only time a connection touches semaphore 0
+    conn->ident.id = room_new_sender_id(shm, gw->session.semid);
+    conn->joined = 1;
+    conn->sub_index = gw->nsubs;
+    gw->subs[gw->nsubs++] = conn;
+
+    char welcome[8];
+    wire_put32(welcome, conn->ident.id);
+    wire_put32(welcome + 4, shm->participant_count + (uint32_t)gw->nsubs - 1);
+    if (!gw_send_frame(gw, conn, WIRE_WELCOME, welcome, sizeof(welcome))) {
+        return 0;
+    }
+
+    snprintf(event, sizeof(event), "%s joined the chat", conn->ident.name);
+    room_publish(shm, &conn->ident, event, strlen(event), MSG_TYPE_SYSTEM);
+    log_system_event(event);
+    return 1;
+}
+
+// Publish the SEND frames waiting in the connection's input, in batches.
+// If the ring fills, the rest stays buffered and reading from this client
+// pauses until a retry gets through. Returns 0 if the connection was closed.
+static int gw_process(struct gateway* gw, struct gw_conn* conn) {
+    struct chat_outgoing batch[CHAT_SEND_BATCH_MAX];
+    size_t ends[CHAT_SEND_BATCH_MAX];
+
+    while (1) {
+        size_t count = 0, pos = conn->in_pos;
+        while (count < CHAT_SEND_BATCH_MAX) {
+            int type;
+            const char* payload;
+            size_t length;
+            long size = wire_frame(conn->in + pos, conn->in_len - pos, &type, &payload, &length);
+            if (size == 0) {
+                break;
+            }
+            if (size < 0) {
+                return gw_reject(gw, conn, "bad frame length");
+            }
+            if (!conn->joined) {
+                if (type != WIRE_HELLO) {
+                    return gw_reject(gw, conn, "the first frame must be HELLO");
+                }
+                if (!gw_hello(gw, conn, payload, length)) {
+                    return 0;
+                }
+                conn->in_pos = pos += (size_t)size;
+                continue;
+            }
+            if (type != WIRE_SEND || length == 0) {
+                return gw_reject(gw, conn, "unexpected frame");
+            }
+            int msg_type = (unsigned char)payload[0];
+            if (msg_type != MSG_TYPE_NORMAL && msg_type != MSG_TYPE_SYSTEM) {
+                return gw_reject(gw, conn, "unknown message type");
+            }
+            // The buffer is ours, so repair the text where it lies
+            char* text = conn->in + pos + WIRE_HEADER_SIZE + 1;
+            text_sanitize(text, length - 1);
+            batch[count] = (struct chat_outgoing){text, length - 1, msg_type};
+            pos += (size_t)size;
+            ends[count++] = pos;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        uint32_t first_id;
+        size_t sent = room_publish_batch(gw->session.shm, &conn->ident, batch, count, &first_id);
+        if (sent > 0) {
+            for (size_t i = 0; i < sent; i++) {
+                if (batch[i].length > 0) {
+                    journal_append(gw->session.shm->epoch << 32 | (first_id + (uint32_t)i),
+                                   batch[i].type, conn->ident.name, batch[i].content, batch[i].length);
+                }
+            }
+            conn->in_pos = ends[sent - 1];
+            gw->published += sent;
+            stat_add(&gw->session.me->sent, sent);
+        }
+        if (sent < count) {
+            if (!conn->blocked) {
+                conn->blocked = 1;
+                gw->blocked++;
+                gw_update_events(gw, conn);
+            }
+            return 1;
+        }
+    }
+
+    if (conn->blocked) {
+        conn->blocked = 0;
+        gw->blocked--;
+        gw_update_events(gw, conn);
+    }
+    // Keep the unparsed remainder at the front of the buffer
+    if (conn->in_pos > 0) {
+        memmove(conn->in, conn->in + conn->in_pos, conn->in_len - conn->in_pos);
+        conn->in_len -= conn->in_pos;
+        conn->in_pos = 0;
+    }
+    return 1;
+}
+
+static void gw_read(struct gateway* gw, struct gw_conn* conn) {
+    if (conn->in_cap - conn->in_len < GW_READ_SIZE) {
+        size_t cap = conn->in_cap ? conn->in_cap * 2 : GW_READ_SIZE * 2;
+        char* grown = realloc(conn->in, cap);
+        if (!grown) {
+            gw_close(gw, conn, "out of memory");
+            return;
+        }
+        conn->in = grown;
+        conn->in_cap = cap;
+    }
+
+    ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+    if (n == 0 || (n == -1 && errno != EINTR && errno != EAGAIN)) {
+        gw_close(gw, conn, n == 0 ? NULL : strerror(errno));
+        return;
+    }
+    if (n > 0) {
+        conn->in_len += (size_t)n;
+        gw_process(gw, conn);
+    }
+}
+
+static void gw_accept(struct gateway* gw, int listen_fd) {
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EINTR) {
+                perror("chatd: accept failed");
+            }
+            return;
+        }
+        if ((size_t)fd >= gw->conns_cap) {
+            close(fd);
+            continue;
+        }
+        if (listen_fd == gw->tcp_fd) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        struct gw_conn* conn = calloc(1, sizeof(*conn));
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+        if (!conn || epoll_ctl(gw->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        gw->conns[fd] = conn;
+    }
+}
+
+static int gw_listen_unix(const char* path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "chatd: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("chatd: socket failed");
+        return -1;
+    }
+    // A socket file left by a gateway that died is just in the way
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror("chatd: cannot listen on the Unix socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int gw_listen_tcp(int port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("chatd: socket failed");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror("chatd: cannot listen on TCP");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int gw_watch(struct gateway* gw, int fd) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return fd == -1 || epoll_ctl(gw->epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// Raise the descriptor limit as far as allowed; every client holds one
+static size_t gw_raise_fd_limit(void) {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == -1) {
+        return 1024;
+    }
+    if (lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        getrlimit(RLIMIT_NOFILE, &lim);
+    }
+    return lim.rlim_cur > GW_MAX_CLIENTS ? GW_MAX_CLIENTS : (size_t)lim.rlim_cur;
+}
+
+static void gw_loop(struct gateway* gw) {
+    struct epoll_event events[GW_MAX_EVENTS];
+
+    while (!interrupted) {
+        int n = epoll_wait(gw->epfd, events, GW_MAX_EVENTS, gw->blocked ? GW_RETRY_MS : -1);
+        if (n == -1 && errno != EINTR) {
+            perror("chatd: epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == gw->unix_fd || fd == gw->tcp_fd) {
+                gw_accept(gw, fd);
+                continue;
+            }
+            if (fd == gw->event_fd) {
+                uint64_t count;
+                if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                    perror("chatd: eventfd read failed");
+                }
+                continue;
+            }
+            struct gw_conn* conn = gw->conns[fd];
+            if (!conn) {
+                continue;  // Closed earlier in this batch
+            }
+            if ((events[i].events & EPOLLOUT) && !gw_flush(gw, conn)) {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                gw_read(gw, conn);
+            }
+        }
+
+        // Retry stuck publishes; a dead member may be what pins the ring
+        if (gw->blocked) {
+            room_recover(gw->session.shm, gw->session.semid);
+            for (size_t i = gw->nsubs; i-- > 0;) {
+                if (gw->subs[i]->blocked) {
+                    gw_process(gw, gw->subs[i]);
+                }
+            }
+        }
+        if (gw->ring_paused && gw->chunk_bytes < CHATD_MEMORY_HIGH_WATER / 2) {
+            gw->ring_paused = 0;
+        }
+        gw_fanout(gw);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    struct gateway gw = {.unix_fd = -1, .tcp_fd = -1, .socket_path = CHATD_SOCKET_PATH};
+    const char* name = "chatd";
+    char event[256];
+    int port = 0;
+    int opt;
+
+    if (!room_config_parse(&argc, argv)) {
+        return 1;
+    }
+    while ((opt = getopt(argc, argv, "s:p:n:h")) != -1) {
+        switch (opt) {
+            case 's':
+                gw.socket_path = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                if (port <= 0 || port > 65535) {
+                    fprintf(stderr, "Invalid port: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // A client hanging up mid-write shows up as EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
+    gw.conns_cap = gw_raise_fd_limit();
+    gw.conns = calloc(gw.conns_cap, sizeof(*gw.conns));
+    gw.subs = calloc(gw.conns_cap, sizeof(*gw.subs));
+    if (!gw.conns || !gw.subs) {
+        fprintf(stderr, "chatd: out of memory\n");
+        return 1;
+    }
+
+    if (!chat_open(&gw.session, name)) {
+        return 1;
+    }
+    gw.event_fd = chat_poll_fd(&gw.session);
+    gw.epfd = epoll_create1(EPOLL_CLOEXEC);
+    gw.unix_fd = gw_listen_unix(gw.socket_path);
+    if (port > 0) {
+        gw.tcp_fd = gw_listen_tcp(port);
+    }
+    if (gw.event_fd == -1 || gw.epfd == -1 || gw.unix_fd == -1 || (port > 0 && gw.tcp_fd == -1) ||
+        !gw_watch(&gw, gw.event_fd) || !gw_watch(&gw, gw.unix_fd) || !gw_watch(&gw, gw.tcp_fd)) {
+        chat_close(&gw.session);
+        return 1;
+    }
+
+    printf("chatd: serving the room on %s", gw.socket_path);
+    if (port > 0) {
+        printf(" and 127.0.0.1:%d", port);
+    }
+    printf(" (up to %zu clients)\n", gw.conns_cap);
+    fflush(stdout);
+    snprintf(event, sizeof(event), "chatd started on %s", gw.socket_path);
+    log_system_event(event);
+
+    gw_loop(&gw);
+
+    while (gw.nsubs > 0) {
+        gw_close(&gw, gw.subs[gw.nsubs - 1], "gateway shutting down");
+    }
+    for (size_t fd = 0; fd < gw.conns_cap; fd++) {
+        if (gw.conns[fd]) {
+            gw_close(&gw, gw.conns[fd], NULL);
+        }
+    }
+    close(gw.unix_fd);
+    unlink(gw.socket_path);
+    if (gw.tcp_fd != -1) {
+        close(gw.tcp_fd);
+    }
+    close(gw.epfd);
+
+    snprintf(event, sizeof(event),
+             "chatd stopped: %llu message(s) fanned out, %llu published, %llu slow client(s) dropped",
+             (unsigned long long)gw.delivered, (unsigned long long)gw.published,
+             (unsigned long long)gw.dropped_slow);
+    log_system_event(event);
+    printf("%s\n", event);
+    chat_close(&gw.session);
+    return 0;
+}
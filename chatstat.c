@@ -0,0 +1,194 @@
+/*
+ * chatstat.c
+ * OS Chat System - runtime statistics inspector
+ * Attaches to a room's segment read-only and prints the shared counters,
+ * once or every interval. It never takes semaphore 0, so it cannot stall a
+ * join or leave, and it never writes to the segment.
+ */
+
+#include "chat_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void signal_handler(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-c channel] [-i interval_ms] [-n count] [--shm sysv|posix]\n", prog);
+    printf("  -c channel:     a named channel's room instead of the main one\n");
+    printf("  -i interval_ms: print a new snapshot every interval (default: print once)\n");
+    printf("  -n count:       stop after count snapshots (default: until interrupted)\n");
+    printf("  --shm:          the backend the room was started with (default sysv)\n");
+}
+
+static uint64_t load(_Atomic uint64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// One snapshot. prev_head/prev_ns carry the previous snapshot so streaming
+// mode can show the publish rate.
+static void print_stats(struct room_segment* seg, uint32_t* prev_head, uint64_t* prev_ns) {
+    struct shmseg* shm = seg->shm;
+    static uint64_t prev_drained[MAX_USERS];
+    struct chat_stats* st = &shm->stats;
+    uint32_t head = atomic_load(&shm->head);
+    uint32_t tail = atomic_load(&shm->tail);
+    uint64_t now = chat_now_ns();
+    uint64_t acquires = load(&st->lock_acquires);
+    int members = 0;
+
+    int orphans = 0;
+
+    for (int i = 0; i < MAX_USERS; i++) {
+        uint32_t state = atomic_load(&shm->participants[i].state);
+        members += state == PARTICIPANT_ACTIVE;
+        orphans += state == PARTICIPANT_ORPHANED;
+    }
+
+    time_t wall = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&wall));
+    if (shm->header.channel[0] != '\0') {
+        printf("%s=== Channel #%.*s stats at %s ===%s\n", INFO_COLOR, (int)sizeof(shm->header.channel),
+               shm->header.channel, stamp, COLOR_RESET);
+    } else {
+        printf("%s=== Chat room stats at %s ===%s\n", INFO_COLOR, stamp, COLOR_RESET);
+    }
+    printf("Members:      %d of %d, %d orphaned (generation %u)\n", members, MAX_USERS, orphans,
+           atomic_load(&shm->header.generation));
+    printf("Messages:     %u published", head);
+    if (*prev_ns != 0 && now > *prev_ns) {
+        printf(" (%.1f/s)", (double)(head - *prev_head) * 1e9 / (double)(now - *prev_ns));
+    }
+    printf("\n");
+    printf("Segment:      %s, %zu bytes mapped\n", room_backend_name(seg->backend), seg->size);
+    printf("Queue depth:  %u now, %llu max, %u capacity\n", head - tail,
+           (unsigned long long)load(&st->max_depth), shm->header.ring_capacity);
+    printf("Queue full:   %llu ring, %llu arena\n",
+           (unsigned long long)load(&st->queue_full), (unsigned long long)load(&st->arena_full));
+    printf("Arena:        %llu of %llu bytes handed out\n",
+           (unsigned long long)load(&shm->arena.top), (unsigned long long)shm->header.arena_size);
+    printf("Lock waits:   %llu acquisitions, %.1f us avg, %.1f us max\n",
+           (unsigned long long)acquires,
+           acquires ? (double)load(&st->lock_wait_ns) / (double)acquires / 1000.0 : 0.0,
+           (double)load(&st->lock_wait_max_ns) / 1000.0);
+    printf("Bytes logged: %llu\n", (unsigned long long)load(&st->bytes_logged));
+    uint64_t deliveries;
+    uint64_t p50 = room_latency_percentile(shm, 50.0, &deliveries);
+    uint64_t p99 = room_latency_percentile(shm, 99.0, &deliveries);
+    printf("Delivery:     %llu, %.1f us p50, %.1f us p99, %.1f us max\n", (unsigned long long)deliveries,
+           (double)p50 / 1000.0, (double)p99 / 1000.0, (double)load(&st->latency_max_ns) / 1000.0);
+
+    if (members + orphans > 0) {
+        printf("\n%-*s %8s %10s %10s %6s %12s %8s %10s\n", MAX_USERNAME_LEN, "Member", "PID", "Sent",
+               "Received", "Lag", "Latency us", "Outbox", "Drained/s");
+        for (int i = 0; i < MAX_USERS; i++) {
+            struct chat_participant* p = &shm->participants[i];
+            uint32_t state = atomic_load(&p->state);
+            if (state == PARTICIPANT_FREE) {
+                continue;
+            }
+            char name[MAX_USERNAME_LEN];
+            memcpy(name, p->name, sizeof(name));
+            name[MAX_USERNAME_LEN - 1] = '\0';
+            // Outbox drain rate since the previous sample, when streaming
+            uint64_t drained = load(&p->outbox_drained);
+            char rate[16] = "-";
+            if (*prev_ns != 0 && now > *prev_ns && drained >= prev_drained[i]) {
+                snprintf(rate, sizeof(rate), "%.1f",
+                         (double)(drained - prev_drained[i]) * 1e9 / (double)(now - *prev_ns));
+            }
+            prev_drained[i] = drained;
+            printf("%-*s %8d %10llu %10llu %6u %12.1f %8llu %10s%s\n", MAX_USERNAME_LEN, name, (int)p->pid,
+                   (unsigned long long)load(&p->sent), (unsigned long long)load(&p->received),
+                   head - atomic_load(&p->cursor), (double)load(&p->latency_ns) / 1000.0,
+                   (unsigned long long)load(&p->outbox_depth), rate,
+                   state == PARTICIPANT_ORPHANED ? "  (orphaned)" : "");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+
+    *prev_head = head;
+    *prev_ns = now;
+}
+
+int main(int argc, char *argv[]) {
+    long interval_ms = 0;
+    long count = -1;
+    const char* channel = "";
+    int opt;
+
+    if (!room_config_parse(&argc, argv)) {
+        return 1;
+    }
+    while ((opt = getopt(argc, argv, "c:i:n:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            channel = optarg[0] == '#' ? optarg + 1 : optarg;
+            break;
+        case 'i':
+            interval_ms = atol(optarg);
+            break;
+        case 'n':
+            count = atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (interval_ms < 0 || optind != argc || (channel[0] != '\0' && !room_channel_valid(channel))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (interval_ms == 0) {
+        count = 1;
+    }
+
+    struct room_segment seg;
+    int found = segment_open(&seg, channel, 1);
+    if (found <= 0) {
+        if (found == 0) {
+            printf("%sNo chat room is running (no %s segment with key 0x%x).%s\n", ERROR_COLOR,
+                   room_backend_name(room_config.backend), room_channel_key(SHM_KEY, channel), COLOR_RESET);
+        }
+        return 1;
+    }
+    if (!seg.shm || !room_layout_valid(seg.shm, seg.size)) {
+        printf("%sThe room segment is not initialized or is from another build (expected layout %u); "
+               "rebuild chatstat.%s\n", ERROR_COLOR, ROOM_LAYOUT_VERSION, COLOR_RESET);
+        segment_detach(&seg);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    uint32_t prev_head = 0;
+    uint64_t prev_ns = 0;
+    while (!interrupted && count != 0) {
+        print_stats(&seg, &prev_head, &prev_ns);
+        if (count > 0) {
+            count--;
+        }
+        if (count != 0) {
+            struct timespec delay = {interval_ms / 1000, (interval_ms % 1000) * 1000000};
+            nanosleep(&delay, NULL);
+        }
+    }
+
+    segment_detach(&seg);
+    return 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * chattrace.c
+ * OS Chat System - lock-contention trace analyzer
+ * Reads the trace files chat processes write with CHAT_TRACE=<file> and
+ * reports, per call site that takes semaphore 0, how long it waited for the
+ * lock, how long it held it, how long it kept other processes waiting and
+ * what it did while holding it, then flags the worst offenders.
+ */
+
+#include "chat_common.h"
+#include "chat_histogram.h"
+#include "chat_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define TRACE_DEFAULT_FILE      "chat.trace"
+#define TRACE_DEFAULT_THRESHOLD 100   // Microseconds of hold time worth flagging
+#define TRACE_DEFAULT_TOP       5
+
+// Everything recorded at one place in the code
+struct site_stats {
+    char func[TRACE_FUNC_MAX];
+    uint32_t line;
+    uint64_t acquired;
+    uint64_t busy;            // Try-locks that found it taken
+    struct chat_histogram wait;
+    struct chat_histogram hold;
+    uint64_t hold_total;
+    uint64_t blocking_ns;     // Time other threads spent waiting while this site held it
+    uint64_t logs_held;       // Log lines queued while this site held it
+    uint64_t flushes_held;    // Tracer flushes while this site held it
+};
+
+// One thread's position in its own event stream; chunks of one thread are
+// written in order, so a request and its release may sit in different ones
+struct thread_state {
+    int32_t pid, tid;
+    int waiting, holding;
+    int wait_site, hold_site;
+    uint64_t requested_ns, acquired_ns;
+};
+
+// A stretch of time on one semaphore, for matching waits against holds
+struct lock_span {
+    uint64_t start, end;
+    uint64_t semid;
+    int site;
+    int thread;
+};
+
+struct trace_stats {
+    struct site_stats* sites;
+    size_t site_count, site_cap;
+    struct thread_state* threads;
+    size_t thread_count, thread_cap;
+    struct lock_span* holds;
+    size_t hold_count, hold_cap;
+    struct lock_span* waits;
+    size_t wait_count, wait_cap;
+    uint64_t events, chunks, torn_bytes;
+    uint64_t first_ns, last_ns;
+    int processes;
+    uint64_t published, batches, consumed, full_ring, full_arena, logs;
+    struct chat_histogram space_wait;
+    struct chat_histogram flush;
+};
+
+static struct trace_stats trace;
+
+// Room for one more element in a growable array
+static void* grow(void* array, size_t* cap, size_t count, size_t size) {
+    if (count < *cap) {
+        return array;
+    }
+    size_t want = *cap ? *cap * 2 : 64;
+    void* grown = realloc(array, want * size);
+    if (!grown) {
+        perror("realloc failed");
+        exit(1);
+    }
+    *cap = want;
+    return grown;
+}
+
+static int site_index(const struct trace_site* site) {
+    for (size_t i = 0; i < trace.site_count; i++) {
+        if (trace.sites[i].line == site->line &&
+            strncmp(trace.sites[i].func, site->func, TRACE_FUNC_MAX) == 0) {
+            return (int)i;
+        }
+    }
+    trace.sites = grow(trace.sites, &trace.site_cap, trace.site_count, sizeof(*trace.sites));
+    struct site_stats* s = &trace.sites[trace.site_count];
+    memset(s, 0, sizeof(*s));
+    memcpy(s->func, site->func, TRACE_FUNC_MAX);
+    s->func[TRACE_FUNC_MAX - 1] = '\0';
+    s->line = site->line;
+    hist_init(&s->wait);
+    hist_init(&s->hold);
+    return (int)trace.site_count++;
+}
+
+static int thread_index(int32_t pid, int32_t tid) {
+    int new_process = 1;
+    for (size_t i = 0; i < trace.thread_count; i++) {
+        if (trace.threads[i].pid == pid && trace.threads[i].tid == tid) {
+            return (int)i;
+        }
+        new_process &= trace.threads[i].pid != pid;
+    }
+    trace.processes += new_process;
+    trace.threads = grow(trace.threads, &trace.thread_cap, trace.thread_count, sizeof(*trace.threads));
+    trace.threads[trace.thread_count] = (struct thread_state){.pid = pid, .tid = tid};
+    return (int)trace.thread_count++;
+}
+
+static void add_span(struct lock_span** spans, size_t* count, size_t* cap, struct lock_span span) {
+    *spans = grow(*spans, cap, *count, sizeof(**spans));
+    (*spans)[(*count)++] = span;
+}
+
+static void trace_event(int thread, int site, const struct trace_record* ev) {
+    struct thread_state* t = &trace.threads[thread];
+    struct site_stats* s = &trace.sites[site];
+
+    switch (ev->type) {
+    case TRACE_LOCK_REQUEST:
+        t->waiting = 1;
+        t->wait_site = site;
+        t->requested_ns = ev->ns;
+        break;
+    case TRACE_LOCK_ACQUIRED:
+        if (t->waiting) {
+            hist_record(&s->wait, ev->ns - t->requested_ns);
+            add_span(&trace.waits, &trace.wait_count, &trace.wait_cap,
+                     (struct lock_span){t->requested_ns, ev->ns, ev->arg, site, thread});
+        }
+        s->acquired++;
+        t->waiting = 0;
+        t->holding = 1;
+        t->hold_site = site;
+        t->acquired_ns = ev->ns;
+        break;
+    case TRACE_LOCK_BUSY:
+        s->busy++;
+        t->waiting = 0;
+        break;
+    case TRACE_LOCK_RELEASED:
+        // Charged to the site that took it, wherever it was let go
+        if (t->holding) {
+            struct site_stats* holder = &trace.sites[t->hold_site];
+            hist_record(&holder->hold, ev->ns - t->acquired_ns);
+            holder->hold_total += ev->ns - t->acquired_ns;
+            add_span(&trace.holds, &trace.hold_count, &trace.hold_cap,
+                     (struct lock_span){t->acquired_ns, ev->ns, ev->arg, t->hold_site, thread});
+        }
+        t->holding = 0;
+        break;
+    case TRACE_PUBLISH:
+        trace.published += ev->arg & 0xffffffffu;
+        trace.batches++;
+        break;
+    case TRACE_ROOM_FULL:
+        if (ev->arg) {
+            trace.full_ring++;
+        } else {
+            trace.full_arena++;
+        }
+        break;
+    case TRACE_CONSUME:
+        trace.consumed++;
+        break;
+    case TRACE_SPACE_WAIT:
+        hist_record(&trace.space_wait, ev->arg);
+        break;
+    case TRACE_LOG:
+        trace.logs++;
+        if (t->holding) {
+            trace.sites[t->hold_site].logs_held++;
+        }
+        break;
+    case TRACE_FLUSH:
+        hist_record(&trace.flush, ev->arg);
+        if (t->holding) {
+            trace.sites[t->hold_site].flushes_held++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void trace_chunk(const struct trace_chunk* chunk) {
+    const struct trace_site* sites = trace_chunk_sites(chunk);
+    const struct trace_record* events = trace_chunk_events(chunk);
+    int map[TRACE_MAX_SITES];
+    int thread = thread_index(chunk->pid, chunk->tid);
+
+    for (uint32_t i = 0; i < chunk->site_count; i++) {
+        map[i] = site_index(&sites[i]);
+    }
+    for (uint32_t i = 0; i < chunk->event_count; i++) {
+        const struct trace_record* ev = &events[i];
+        if (ev->site >= chunk->site_count) {
+            continue;
+        }
+        if (trace.events == 0 || ev->ns < trace.first_ns) {
+            trace.first_ns = ev->ns;
+        }
+        if (ev->ns > trace.last_ns) {
+            trace.last_ns = ev->ns;
+        }
+        trace.events++;
+        trace_event(thread, map[ev->site], ev);
+    }
+    trace.chunks++;
+}
+
+// Walk a trace file chunk by chunk. A torn chunk (a process killed mid
+// write) is skipped by searching for the next magic number.
+static int trace_load(const char* path) {
+    size_t size;
+    char* base = journal_map(path, &size);
+
+    if (!base) {
+        printf("%s%s: no trace there (run with CHAT_TRACE=%s).%s\n", ERROR_COLOR, path, path, COLOR_RESET);
+        return 0;
+    }
+    uint64_t offset = 0;
+    while (offset + sizeof(uint64_t) <= size) {
+        const struct trace_chunk* chunk = trace_chunk_at(base, size, offset);
+        if (chunk) {
+            trace_chunk(chunk);
+            offset += chunk->length;
+            continue;
+        }
+        offset += sizeof(uint64_t);
+        trace.torn_bytes += sizeof(uint64_t);
+    }
+    munmap(base, size);
+    return 1;
+}
+
+/* ---- Analysis ---- */
+
+static int span_cmp(const void* a, const void* b) {
+    const struct lock_span* x = a;
+    const struct lock_span* y = b;
+    if (x->semid != y->semid) {
+        return x->semid < y->semid ? -1 : 1;
+    }
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// Charge every wait to whoever held the semaphore during it. Holds of one
+// semaphore never overlap, so sorted by start they are sorted by end too.
+static void charge_waits(void) {
+    qsort(trace.holds, trace.hold_count, sizeof(*trace.holds), span_cmp);
+
+    for (size_t w = 0; w < trace.wait_count; w++) {
+        const struct lock_span* wait = &trace.waits[w];
+        size_t lo = 0, hi = trace.hold_count;
+        // First hold of this semaphore that ends after the wait began
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            const struct lock_span* h = &trace.holds[mid];
+            if (h->semid < wait->semid || (h->semid == wait->semid && h->end <= wait->start)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for (size_t i = lo; i < trace.hold_count; i++) {
+            const struct lock_span* h = &trace.holds[i];
+            if (h->semid != wait->semid || h->start >= wait->end) {
+                break;
+            }
+            if (h->thread == wait->thread) {
+                continue;
+            }
+            uint64_t start = h->start > wait->start ? h->start : wait->start;
+            uint64_t end = h->end < wait->end ? h->end : wait->end;
+            trace.sites[h->site].blocking_ns += end - start;
+        }
+    }
+}
+
+/* ---- Report ---- */
+
+static double us(uint64_t ns) {
+    return (double)ns / 1000.0;
+}
+
+static void print_site_label(const struct site_stats* s, char* out, size_t len) {
+    snprintf(out, len, "%s:%u", s->func, s->line);
+}
+
+static void print_sites(void) {
+    char label[TRACE_FUNC_MAX + 16];
+
+    printf("\n%-28s %8s  %-26s  %-26s  %10s  %s\n", "Call site", "Taken", "Wait p50/p99/max us",
+           "Hold p50/p99/max us", "Blocked us", "Logged");
+    for (size_t i = 0; i < trace.site_count; i++) {
+        const struct site_stats* s = &trace.sites[i];
+        if (s->acquired == 0 && s->busy == 0) {
+            continue;
+        }
+        char wait[32], hold[32];
+        snprintf(wait, sizeof(wait), "%.1f/%.1f/%.1f", us(hist_percentile(&s->wait, 50.0)),
+                 us(hist_percentile(&s->wait, 99.0)), us(s->wait.max));
+        snprintf(hold, sizeof(hold), "%.1f/%.1f/%.1f", us(hist_percentile(&s->hold, 50.0)),
+                 us(hist_percentile(&s->hold, 99.0)), us(s->hold.max));
+        print_site_label(s, label, sizeof(label));
+        printf("%-28s %8llu  %-26s  %-26s  %10.1f  %llu\n", label, (unsigned long long)s->acquired,
+               s->wait.total ? wait : "-", s->hold.total ? hold : "-", us(s->blocking_ns),
+               (unsigned long long)s->logs_held);
+        if (s->busy) {
+            printf("%-28s %8s  found it taken %llu time(s) and gave up\n", "", "",
+                   (unsigned long long)s->busy);
+        }
+    }
+}
+
+// Worse first: kept others waiting longest, then held it longest
+static int offender_cmp(const void* a, const void* b) {
+    const struct site_stats* x = &trace.sites[*(const int*)a];
+    const struct site_stats* y = &trace.sites[*(const int*)b];
+    if (x->blocking_ns != y->blocking_ns) {
+        return x->blocking_ns > y->blocking_ns ? -1 : 1;
+    }
+    return x->hold.max > y->hold.max ? -1 : x->hold.max < y->hold.max;
+}
+
+static void print_offenders(uint64_t threshold_ns, int top) {
+    int* order = malloc((trace.site_count + 1) * sizeof(*order));
+    int flagged = 0;
+    char label[TRACE_FUNC_MAX + 16];
+
+    if (!order) {
+        return;
+    }
+    for (size_t i = 0; i < trace.site_count; i++) {
+        const struct site_stats* s = &trace.sites[i];
+        if (s->blocking_ns > 0 || s->logs_held > 0 || (s->hold.total && s->hold.max >= threshold_ns)) {
+            order[flagged++] = (int)i;
+        }
+    }
+    qsort(order, (size_t)flagged, sizeof(*order), offender_cmp);
+
+    printf("\n%sWorst offenders%s (held over %.0f us, kept others waiting or logged under the lock):\n",
+           INFO_COLOR, COLOR_RESET, us(threshold_ns));
+    if (flagged == 0) {
+        printf("  None.\n");
+    }
+    for (int i = 0; i < flagged && i < top; i++) {
+        const struct site_stats* s = &trace.sites[order[i]];
+        print_site_label(s, label, sizeof(label));
+        printf("  %d. %s%s%s held semaphore 0 for up to %.1f us (p99 %.1f us, %.1f ms in all)",
+               i + 1, COLOR_BOLD, label, COLOR_RESET, us(s->hold.max), us(hist_percentile(&s->hold, 99.0)),
+               (double)s->hold_total / 1e6);
+        if (s->blocking_ns > 0) {
+            printf(", keeping others waiting %.1f us", us(s->blocking_ns));
+        }
+        printf("\n");
+        if (s->logs_held > 0) {
+            printf("     queued %llu log line(s) while holding it\n", (unsigned long long)s->logs_held);
+        }
+        if (s->flushes_held > 0) {
+            printf("     %llu tracer flush(es) landed inside; part of that time is the tracer's\n",
+                   (unsigned long long)s->flushes_held);
+        }
+    }
+    free(order);
+}
+
+static void report(const char* files, uint64_t threshold_ns, int top) {
+    double span = trace.last_ns > trace.first_ns ? (double)(trace.last_ns - trace.first_ns) / 1e9 : 0.0;
+    uint64_t acquired = 0, held = 0;
+
+    for (size_t i = 0; i < trace.site_count; i++) {
+        acquired += trace.sites[i].acquired;
+        held += trace.sites[i].hold_total;
+    }
+
+    printf("%s=== Trace of %s ===%s\n", INFO_COLOR, files, COLOR_RESET);
+    printf("Events:      %llu in %llu chunk(s) from %d process(es), %zu thread(s), over %.3f s",
+           (unsigned long long)trace.events, (unsigned long long)trace.chunks, trace.processes,
+           trace.thread_count, span);
+    if (trace.torn_bytes) {
+        printf("; %llu torn byte(s) skipped", (unsigned long long)trace.torn_bytes);
+    }
+    printf("\n");
+    printf("Semaphore 0: %llu acquisition(s), held %.3f ms in all", (unsigned long long)acquired,
+           (double)held / 1e6);
+    if (span > 0) {
+        printf(" (%.2f%% of the traced time)", (double)held / 1e9 / span * 100.0);
+    }
+    printf("\n");
+    printf("Messages:    %llu published in %llu batch(es), %llu consumed; %llu ring and %llu arena "
+           "refusal(s)\n",
+           (unsigned long long)trace.published, (unsigned long long)trace.batches,
+           (unsigned long long)trace.consumed, (unsigned long long)trace.full_ring,
+           (unsigned long long)trace.full_arena);
+    if (trace.space_wait.total) {
+        printf("Space waits: %llu, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               (unsigned long long)trace.space_wait.total, us(hist_percentile(&trace.space_wait, 50.0)),
+               us(hist_percentile(&trace.space_wait, 99.0)), us(trace.space_wait.max));
+    }
+    printf("Log lines:   %llu queued\n", (unsigned long long)trace.logs);
+    if (trace.flush.total) {
+        printf("Tracer:      %llu buffer flush(es), max %.1f us\n", (unsigned long long)trace.flush.total,
+               us(trace.flush.max));
+    }
+
+    if (acquired == 0) {
+        printf("\nNothing took semaphore 0 while tracing.\n");
+        return;
+    }
+    print_sites();
+    print_offenders(threshold_ns, top);
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [--threshold US] [--top N] [FILE...]\n", prog);
+    printf("  FILE         trace files written with CHAT_TRACE=FILE (default %s)\n", TRACE_DEFAULT_FILE);
+    printf("  --threshold  flag sections that held semaphore 0 this long (default %d us)\n",
+           TRACE_DEFAULT_THRESHOLD);
+    printf("  --top        offenders to list (default %d)\n", TRACE_DEFAULT_TOP);
+}
+
+int main(int argc, char* argv[]) {
+    double threshold = TRACE_DEFAULT_THRESHOLD;
+    int top = TRACE_DEFAULT_TOP;
+    char files[256] = "";
+    int loaded = 0, given = 0;
+
+    hist_init(&trace.space_wait);
+    hist_init(&trace.flush);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            given++;
+            if (trace_load(argv[i])) {
+                size_t used = strlen(files);
+                snprintf(files + used, sizeof(files) - used, "%s%s", loaded++ ? ", " : "", argv[i]);
+            }
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (threshold < 0 || top < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (given == 0 && trace_load(TRACE_DEFAULT_FILE)) {
+        snprintf(files, sizeof(files), "%s", TRACE_DEFAULT_FILE);
+        loaded++;
+    }
+    if (loaded == 0) {
+        return 1;
+    }
+
+    charge_waits();
+    report(files, (uint64_t)(threshold * 1000.0), top);
+    return 0;
+}
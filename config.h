@@ -9,6 +9,128 @@
 #define SEM_KEY 0x5678
 #endif
 #define CHAT_CONFIG_VERSION "2.1"
-#define MAX_USERS 2
+#define MAX_USERS 64
+
+// Slots in the room's shared-memory ring (must be a power of two)
+#ifndef CHAT_RING_CAPACITY
+#define CHAT_RING_CAPACITY 256
+#endif
+
+#define CHAT_CACHE_LINE 64
+
+// Shared-memory arena for message bodies and the largest body it accepts
+#ifndef CHAT_ARENA_SIZE
+#define CHAT_ARENA_SIZE (16 * 1024 * 1024)
+#endif
+#ifndef CHAT_MAX_PAYLOAD
+#define CHAT_MAX_PAYLOAD (1024 * 1024)
+#endif
+
+// Most messages one sender publishes with a single ring claim and wakeup
+#ifndef CHAT_SEND_BATCH_MAX
+#define CHAT_SEND_BATCH_MAX 128
+#endif
+
+// How long a member whose process died keeps its unread messages for a
+// restart under the same name, and how long a new member waits for the
+// room's creator to finish setting up the segment before calling it stale
+#ifndef CHAT_RESUME_GRACE_SECONDS
+#define CHAT_RESUME_GRACE_SECONDS 30
+#endif
+#ifndef CHAT_ATTACH_TIMEOUT_MS
+#define CHAT_ATTACH_TIMEOUT_MS 2000
+#endif
+
+// Background logger: per-file buffer size (grown up to the max for large
+// messages), how long the writer lingers to batch a burst, fsync policy
+// (0 = never, 1 = every batch, 2 = interval) and the size at which
+// chat_history.log is rotated
+#ifndef CHAT_LOG_BUFFER_SIZE
+#define CHAT_LOG_BUFFER_SIZE (64 * 1024)
+#endif
+#ifndef CHAT_LOG_MAX_BUFFER
+#define CHAT_LOG_MAX_BUFFER (16 * 1024 * 1024)
+#endif
+#ifndef CHAT_LOG_FLUSH_MS
+#define CHAT_LOG_FLUSH_MS 50
+#endif
+#ifndef CHAT_LOG_FSYNC
+#define CHAT_LOG_FSYNC 0
+#endif
+#ifndef CHAT_LOG_FSYNC_INTERVAL_MS
+#define CHAT_LOG_FSYNC_INTERVAL_MS 1000
+#endif
+#ifndef CHAT_LOG_ROTATE_BYTES
+#define CHAT_LOG_ROTATE_BYTES (1024 * 1024)
+#endif
+
+// Log rotation: chat_history.log is also rotated once its first line is
+// this old (0 = size only); rotated generations are gzipped in the
+// background at the given level and only the newest CHAT_LOG_RETAIN kept
+#ifndef CHAT_LOG_ROTATE_SECONDS
+#define CHAT_LOG_ROTATE_SECONDS (24 * 60 * 60)
+#endif
+#ifndef CHAT_LOG_RETAIN
+#define CHAT_LOG_RETAIN 10
+#endif
+#ifndef CHAT_LOG_COMPRESS_LEVEL
+#define CHAT_LOG_COMPRESS_LEVEL 6
+#endif
+
+// Initial size of the client's output buffer (grown for large messages)
+#ifndef CHAT_RENDER_BUFFER_SIZE
+#define CHAT_RENDER_BUFFER_SIZE (16 * 1024)
+#endif
+
+// Client outbox: lines that find the room full wait in process memory, up
+// to this many bytes, and are retried this often until they are all out
+#ifndef CHAT_OUTBOX_MAX_BYTES
+#define CHAT_OUTBOX_MAX_BYTES (64 * 1024 * 1024)
+#endif
+#ifndef CHAT_OUTBOX_RETRY_MS
+#define CHAT_OUTBOX_RETRY_MS 10
+#endif
+
+// Named channels: how many one client can be in at once (the main room
+// included) and the longest name, plus one for the NUL
+#ifndef CHAT_MAX_CHANNELS
+#define CHAT_MAX_CHANNELS 8
+#endif
+#define CHAT_CHANNEL_NAME_MAX 16
+
+// Critical-section tracing (CHAT_TRACE=<file>): events each thread buffers
+// before writing them out as one chunk
+#ifndef CHAT_TRACE_BUFFER_EVENTS
+#define CHAT_TRACE_BUFFER_EVENTS 16384
+#endif
+
+// Bytes of journal between two sparse index entries
+#ifndef CHAT_JOURNAL_INDEX_STRIDE
+#define CHAT_JOURNAL_INDEX_STRIDE (64 * 1024)
+#endif
+
+// chatd gateway: default Unix socket path; bytes queued for one subscriber
+// before it is dropped as too slow; and bytes of encoded messages the
+// gateway may hold in total before it stops reading the ring (it resumes
+// below half of that)
+#ifndef CHATD_SOCKET_PATH
+#define CHATD_SOCKET_PATH "chatd.sock"
+#endif
+#ifndef CHATD_CONN_QUEUE_MAX
+#define CHATD_CONN_QUEUE_MAX (4 * 1024 * 1024)
+#endif
+#ifndef CHATD_MEMORY_HIGH_WATER
+#define CHATD_MEMORY_HIGH_WATER (64 * 1024 * 1024)
+#endif
+
+// Search index: the journal is indexed in segments of this many bytes
+// (searches scan the not yet indexed remainder directly), and /search
+// shows at most this many of the newest matches
+#ifndef CHAT_SEARCH_SEGMENT_BYTES
+#define CHAT_SEARCH_SEGMENT_BYTES (1024 * 1024)
+#endif
+#ifndef CHAT_SEARCH_RESULTS
+#define CHAT_SEARCH_RESULTS 20
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+ * gen_command_table.c
+ * OS Chat System - command table generator
+ * Run by make to write chat_command_table.h: finds a hash seed under which
+ * every name in chat_commands.def lands in its own slot of the smallest
+ * power-of-two table that allows one, and prints that table.
+ */
+
+#define COMMAND_GENERATOR
+#include "chat_command.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_TABLE_BITS 10
+#define SEED_TRIES     1000000
+
+struct entry {
+    const char* name;
+    const char* id;
+};
+
+static const struct entry entries[] = {
+#define CHAT_COMMAND(id, name, usage, help) {name, #id},
+#define CHAT_ALIAS(id, name) {name, #id},
+#include "chat_commands.def"
+#undef CHAT_COMMAND
+#undef CHAT_ALIAS
+};
+
+#define ENTRY_COUNT (sizeof(entries) / sizeof(entries[0]))
+
+// Whether seed gives every name its own slot; fills slots if so
+static int try_seed(uint32_t seed, uint32_t size, int* slots) {
+    for (uint32_t i = 0; i < size; i++) {
+        slots[i] = -1;
+    }
+    for (size_t e = 0; e < ENTRY_COUNT; e++) {
+        uint32_t slot = command_hash(entries[e].name, strlen(entries[e].name), seed) & (size - 1);
+        if (slots[slot] != -1) {
+            return 0;
+        }
+        slots[slot] = (int)e;
+    }
+    return 1;
+}
+
+int main(void) {
+    static int slots[1 << MAX_TABLE_BITS];
+    size_t min_len = 255, max_len = 0;
+
+    for (size_t e = 0; e < ENTRY_COUNT; e++) {
+        const char* name = entries[e].name;
+        size_t len = strlen(name);
+        for (size_t i = 0; i < len; i++) {
+            // The lookup folds input with | 0x20, so names must be stored folded
+            if (((unsigned char)name[i] | 0x20) != (unsigned char)name[i] || name[i] == ' ') {
+                fprintf(stderr, "gen_command_table: '%s' must be lowercase, without spaces\n", name);
+                return 1;
+            }
+        }
+        for (size_t other = 0; other < e; other++) {
+            if (strcmp(entries[other].name, name) == 0) {
+                fprintf(stderr, "gen_command_table: '%s' is listed twice\n", name);
+                return 1;
+            }
+        }
+        if (len == 0 || len > 255) {
+            fprintf(stderr, "gen_command_table: bad name length for '%s'\n", name);
+            return 1;
+        }
+        min_len = len < min_len ? len : min_len;
+        max_len = len > max_len ? len : max_len;
+    }
+
+    uint32_t size = 1;
+    while (size < ENTRY_COUNT) {
+        size <<= 1;
+    }
+    for (; size <= (1u << MAX_TABLE_BITS); size <<= 1) {
+        for (uint32_t seed = 0x811c9dc5u, tries = 0; tries < SEED_TRIES; seed++, tries++) {
+            if (!try_seed(seed, size, slots)) {
+                continue;
+            }
+            printf("/* Generated by gen_command_table from chat_commands.def. Do not edit. */\n");
+            printf("#ifndef CHAT_COMMAND_TABLE_H\n#define CHAT_COMMAND_TABLE_H\n\n");
+            printf("#define COMMAND_HASH_SEED  0x%08xu\n", seed);
+            printf("#define COMMAND_TABLE_SIZE %u\n", size);
+            printf("#define COMMAND_MIN_LEN    %zu\n", min_len);
+            printf("#define COMMAND_MAX_LEN    %zu\n\n", max_len);
+            printf("static const struct chat_command_slot command_table[COMMAND_TABLE_SIZE] = {\n");
+            for (uint32_t i = 0; i < size; i++) {
+                if (slots[i] == -1) {
+                    printf("    {NULL, 0, CMD_NONE},\n");
+                } else {
+                    const struct entry* e = &entries[slots[i]];
+                    printf("    {\"%s\", %zu, %s},\n", e->name, strlen(e->name), e->id);
+                }
+            }
+            printf("};\n\n#endif\n");
+            return 0;
+        }
+    }
+    fprintf(stderr, "gen_command_table: no collision-free seed found\n");
+    return 1;
+}
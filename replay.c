@@ -0,0 +1,656 @@
+/*
+ * replay.c
+ * OS Chat System - log replay load generator
+ * Reads the conversation from the binary journal (or from chat_history.log
+ * and its rotated generations, plain or gzipped) and plays it back through
+ * a real room, one forked process per simulated member, at the original
+ * pace, N times faster or as fast as the room takes it. Reports the
+ * achieved rate, delivery latency and how far behind schedule the senders
+ * fell.
+ */
+
+#include "chat_common.h"
+#include "chat_histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define REPLAY_DEFAULT_USERS   32
+#define REPLAY_DEFAULT_CHANNEL "replay"
+#define REPLAY_IDLE_MS         5000  // Give up on missing deliveries after this long without any
+
+struct replay_options {
+    double speed;      // 1 = the log's own pace
+    int max_rate;      // Ignore the timestamps altogether
+    double max_gap;    // Longest pause kept between two log seconds, 0 = all of it
+    int max_users;     // Senders beyond this are folded onto the first ones
+    int listeners;     // Extra members that only receive
+    const char* channel;
+    int archive;       // Replay every rotated generation before the live log
+};
+
+struct replay_message {
+    int64_t second;      // Log timestamp
+    uint64_t offset_ns;  // When to send it, from the start of the replay
+    size_t text;         // Offset into replay_log.text
+    uint32_t length;
+    int user;
+};
+
+struct replay_log {
+    struct replay_message* messages;
+    size_t count, cap;
+    char* text;  // Every message body, each NUL-terminated
+    size_t text_len, text_cap;
+    char users[MAX_USERS][MAX_USERNAME_LEN];
+    uint64_t user_counts[MAX_USERS];
+    int user_count;
+    int sender_count;  // The members in user_count that come from the log
+    int max_users;
+    size_t skipped;    // Lines or journal records that are not messages
+    size_t duplicates; // Text log copies of a message already read
+    uint64_t* seen;    // Text log: hashes of (second, sender, body) read so far
+    size_t seen_count, seen_cap;
+    struct chat_histogram sizes;
+};
+
+// One simulated member's results; lives in a MAP_SHARED mapping
+struct replay_result {
+    struct chat_histogram latency;  // Publish to delivery, over every message it received
+    struct chat_histogram slip;     // Scheduled send time to actual publish
+    uint64_t sent, received, bytes, full_waits;
+    uint64_t end_ns;
+    int joined;  // 1 joined, -1 could not join
+};
+
+struct replay_shared {
+    _Atomic int ready;            // Members that have joined or given up
+    _Atomic uint64_t start_ns;    // Set by the parent once everyone is ready
+    struct replay_result results[];
+};
+
+static struct replay_log replay;  // archive_grep_file() callbacks take no argument
+
+static int replay_user(const char* name) {
+    char clean[MAX_USERNAME_LEN];
+    size_t len = 0;
+
+    // Channel traffic is logged as "name #channel"
+    while (name[len] != '\0' && name[len] != ' ' && len < MAX_USERNAME_LEN - 1) {
+        clean[len] = name[len];
+        len++;
+    }
+    clean[len] = '\0';
+    for (int i = 0; i < replay.user_count; i++) {
+        if (strcmp(replay.users[i], clean) == 0) {
+            return i;
+        }
+    }
+    if (replay.user_count == replay.max_users) {
+        // Fold the extra senders onto the ones we have, stably
+        uint32_t hash = 2166136261u;
+        for (const char* p = clean; *p; p++) {
+            hash = (hash ^ (unsigned char)*p) * 16777619u;
+        }
+        return (int)(hash % (uint32_t)replay.user_count);
+    }
+    memcpy(replay.users[replay.user_count], clean, len + 1);
+    return replay.user_count++;
+}
+
+// Add one message to the log. name is the sender as logged.
+static void replay_add(int64_t second, const char* name, const char* body, size_t body_len) {
+    if (replay.count == replay.cap) {
+        size_t cap = replay.cap ? replay.cap * 2 : 4096;
+        struct replay_message* grown = realloc(replay.messages, cap * sizeof(*grown));
+        if (!grown) {
+            replay.skipped++;
+            return;
+        }
+        replay.messages = grown;
+        replay.cap = cap;
+    }
+    if (replay.text_len + body_len + 1 > replay.text_cap) {
+        size_t cap = replay.text_cap ? replay.text_cap : 1024 * 1024;
+        while (cap < replay.text_len + body_len + 1) {
+            cap *= 2;
+        }
+        char* grown = realloc(replay.text, cap);
+        if (!grown) {
+            replay.skipped++;
+            return;
+        }
+        replay.text = grown;
+        replay.text_cap = cap;
+    }
+
+    struct replay_message* m = &replay.messages[replay.count++];
+    m->second = second;
+    m->text = replay.text_len;
+    m->length = (uint32_t)body_len;
+    m->user = replay_user(name);
+    memcpy(replay.text + replay.text_len, body, body_len);
+    replay.text[replay.text_len + body_len] = '\0';
+    replay.text_len += body_len + 1;
+    replay.user_counts[m->user]++;
+    hist_record(&replay.sizes, body_len);
+}
+
+// Whether this (second, sender, body) was already read, remembering it if
+// not. Every member logs each main-room message it shows, so the text log
+// holds one copy per member.
+static int replay_seen(int64_t second, const char* name, const char* body, size_t body_len) {
+    uint64_t h = 0xcbf29ce484222325ull ^ (uint64_t)second;
+    for (const char* p = name; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ull;
+    }
+    h = (h ^ 0xff) * 0x100000001b3ull;  // Keeps "a" + "bc" apart from "ab" + "c"
+    for (size_t i = 0; i < body_len; i++) {
+        h = (h ^ (unsigned char)body[i]) * 0x100000001b3ull;
+    }
+    h |= 1;  // 0 marks an empty slot
+
+    if (replay.seen_count * 2 >= replay.seen_cap) {
+        size_t cap = replay.seen_cap ? replay.seen_cap * 2 : 8192;
+        uint64_t* grown = calloc(cap, sizeof(*grown));
+        if (!grown) {
+            return 0;
+        }
+        for (size_t i = 0; i < replay.seen_cap; i++) {
+            if (replay.seen[i]) {
+                size_t slot = replay.seen[i] & (cap - 1);
+                while (grown[slot]) {
+                    slot = (slot + 1) & (cap - 1);
+                }
+                grown[slot] = replay.seen[i];
+            }
+        }
+        free(replay.seen);
+        replay.seen = grown;
+        replay.seen_cap = cap;
+    }
+    size_t slot = h & (replay.seen_cap - 1);
+    while (replay.seen[slot]) {
+        if (replay.seen[slot] == h) {
+            return 1;
+        }
+        slot = (slot + 1) & (replay.seen_cap - 1);
+    }
+    replay.seen[slot] = h;
+    replay.seen_count++;
+    return 0;
+}
+
+// Parse one "[YYYY-MM-DD HH:MM:SS] user: message" line into the log
+static void replay_parse_line(const char* file, const char* line, size_t len) {
+    struct tm tm = {0};
+    int used = 0;
+    (void)file;
+
+    if (sscanf(line, "[%4d-%2d-%2d %2d:%2d:%2d] %n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+               &tm.tm_min, &tm.tm_sec, &used) != 6 || used == 0) {
+        replay.skipped++;
+        return;
+    }
+    const char* sep = strstr(line + used, ": ");
+    if (!sep || sep == line + used) {
+        replay.skipped++;
+        return;
+    }
+    size_t name_len = (size_t)(sep - line - used);
+    const char* body = sep + 2;
+    size_t body_len = len - (size_t)(body - line);
+    // Commands are logged as typed but never reach the room
+    if (body_len == 0 || body_len > CHAT_MAX_PAYLOAD || name_len >= 64 || body[0] == '/') {
+        replay.skipped++;
+        return;
+    }
+
+    char name[64];
+    memcpy(name, line + used, name_len);
+    name[name_len] = '\0';
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    int64_t second = (int64_t)timegm(&tm);  // Only differences matter, so no time zone
+
+    if (replay_seen(second, name, body, body_len)) {
+        replay.duplicates++;
+        return;
+    }
+    replay_add(second, name, body, body_len);
+}
+
+// Read the journal: one record per message, written once by its sender.
+// Returns 0 if path is not a journal.
+static int replay_load_journal(const char* path) {
+    struct journal_view journal;
+    const struct journal_record* rec;
+
+    if (!journal_open(&journal, path, JOURNAL_INDEX_FILE)) {
+        return 0;
+    }
+    if (!journal_record_at(&journal, 0)) {
+        journal_close(&journal);
+        return 0;
+    }
+    uint64_t end = journal_valid_end(&journal);
+    for (uint64_t offset = 0; offset < end && (rec = journal_record_at(&journal, offset)) != NULL;
+         offset += rec->length) {
+        if (rec->type != MSG_TYPE_NORMAL || rec->content_len == 0 || rec->content_len > CHAT_MAX_PAYLOAD) {
+            replay.skipped++;
+            continue;
+        }
+        char name[MAX_USERNAME_LEN];
+        size_t name_len = rec->sender_len < sizeof(name) - 1 ? rec->sender_len : sizeof(name) - 1;
+        memcpy(name, journal_sender(rec), name_len);
+        name[name_len] = '\0';
+        replay_add(rec->timestamp, name, journal_content(rec), rec->content_len);
+    }
+    journal_close(&journal);
+    return 1;
+}
+
+static void replay_load(const char* path, int archive) {
+    if (!archive && replay_load_journal(path)) {
+        return;
+    }
+    if (archive) {
+        static struct archive_generation gens[ARCHIVE_MAX_GENERATIONS];
+        size_t count = archive_list(path, gens, ARCHIVE_MAX_GENERATIONS);
+        char gen_path[ARCHIVE_PATH_MAX];
+
+        for (size_t i = 0; i < count; i++) {
+            if (gens[i].compressed && i > 0 && gens[i - 1].number == gens[i].number) {
+                continue;  // Mid-compression duplicate
+            }
+            archive_generation_path(gen_path, sizeof(gen_path), path, &gens[i]);
+            archive_grep_file(gen_path, "", replay_parse_line);
+        }
+    }
+    archive_grep_file(path, "", replay_parse_line);
+}
+
+// Members that only listen, so fan-out is measured even when few people
+// spoke. Named so they cannot be mistaken for a sender.
+static void replay_add_listeners(int listeners) {
+    replay.sender_count = replay.user_count;
+    for (int n = 1; listeners > 0 && replay.user_count < MAX_USERS; n++) {
+        char name[MAX_USERNAME_LEN];
+        int taken = 0;
+        snprintf(name, sizeof(name), "listener%d", n);
+        for (int u = 0; u < replay.user_count; u++) {
+            taken |= strcmp(replay.users[u], name) == 0;
+        }
+        if (!taken) {
+            memcpy(replay.users[replay.user_count++], name, sizeof(name));
+            listeners--;
+        }
+    }
+}
+
+// Turn log seconds into send times. The log only has whole seconds, so the
+// messages of one second are spread evenly across it; a clock that went
+// backwards (or files given out of order) counts as no time passing.
+static void replay_schedule(const struct replay_options* opt) {
+    uint64_t second_ns = 0;  // Start of the current log second on the replay clock
+
+    for (size_t i = 0; i < replay.count; ) {
+        size_t end = i + 1;
+        while (end < replay.count && replay.messages[end].second <= replay.messages[i].second) {
+            end++;
+        }
+        for (size_t j = i; j < end; j++) {
+            uint64_t within = (uint64_t)(j - i) * 1000000000ull / (end - i);
+            replay.messages[j].offset_ns = opt->max_rate ? 0 : (uint64_t)((double)(second_ns + within) / opt->speed);
+        }
+        if (end < replay.count) {
+            double gap = (double)(replay.messages[end].second - replay.messages[i].second);
+            if (opt->max_gap > 0 && gap > opt->max_gap) {
+                gap = opt->max_gap;
+            }
+            second_ns += (uint64_t)(gap * 1e9);
+        }
+        i = end;
+    }
+}
+
+/* ---- Simulated members ---- */
+
+// Record and consume everything waiting at our cursor
+static int replay_drain(ChatSession* session, struct replay_result* out) {
+    struct chat_message msg;
+    int got = 0;
+
+    while (room_read(session->shm, session->me, &msg)) {
+        if (msg.sender_id != session->me->id) {
+            hist_record(&out->latency, chat_now_ns() - msg.sent_ns);
+            out->received++;
+        }
+        room_advance(session->shm, session->me);
+        got = 1;
+    }
+    return got;
+}
+
+// One member: join, wait for the start, then publish its own lines on
+// schedule while taking in everyone else's. It stops once it has sent all
+// of its lines and received all of theirs.
+static void replay_member(int user, const struct replay_options* opt, struct replay_shared* shared) {
+    struct replay_result* out = &shared->results[user];
+    struct chat_outgoing batch[CHAT_SEND_BATCH_MAX];
+    ChatSession session;
+
+    hist_init(&out->latency);
+    hist_init(&out->slip);
+    if (!chat_open_channel(&session, replay.users[user], opt->channel)) {
+        out->joined = -1;
+        atomic_fetch_add(&shared->ready, 1);
+        exit(1);
+    }
+    out->joined = 1;
+    atomic_fetch_add(&shared->ready, 1);
+
+    struct timespec step = {0, 1000000L};
+    uint64_t start;
+    while ((start = atomic_load(&shared->start_ns)) == 0) {
+        nanosleep(&step, NULL);
+    }
+    uint64_t expected = 0;
+    for (int u = 0; u < replay.user_count; u++) {
+        if (u != user && shared->results[u].joined == 1) {
+            expected += replay.user_counts[u];
+        }
+    }
+
+    struct shmseg* shm = session.shm;
+    size_t next = 0;  // Next message of ours in the log
+    uint64_t idle_since = chat_now_ns();
+    while (next < replay.count && replay.messages[next].user != user) {
+        next++;
+    }
+
+    while (1) {
+        uint32_t seen = atomic_load(&shm->published);
+        uint64_t now = chat_now_ns();
+
+        // Everything of ours that is due goes out in as few claims as fit
+        int blocked = 0;
+        size_t count = 0, scan = next;
+        for (; scan < replay.count && count < CHAT_SEND_BATCH_MAX; scan++) {
+            const struct replay_message* m = &replay.messages[scan];
+            if (m->user != user) {
+                continue;
+            }
+            if (start + m->offset_ns > now) {
+                break;
+            }
+            batch[count++] = (struct chat_outgoing){replay.text + m->text, m->length, MSG_TYPE_NORMAL};
+        }
+        if (count > 0) {
+            uint32_t first;
+            size_t sent = room_publish_batch(shm, session.me, batch, count, &first);
+            uint64_t published = chat_now_ns();
+            for (size_t i = 0; i < sent; i++, next++) {
+                while (replay.messages[next].user != user) {
+                    next++;
+                }
+                if (!opt->max_rate) {
+                    hist_record(&out->slip, published - (start + replay.messages[next].offset_ns));
+                }
+                out->bytes += replay.messages[next].length;
+            }
+            while (next < replay.count && replay.messages[next].user != user) {
+                next++;
+            }
+            out->sent += sent;
+            if (sent < count) {
+                blocked = 1;
+                out->full_waits++;
+            }
+        }
+
+        if (replay_drain(&session, out)) {
+            idle_since = chat_now_ns();
+            continue;
+        }
+        if (next == replay.count && out->received >= expected) {
+            break;
+        }
+
+        // Sleep until something is published or our next line is due;
+        // with the room full, only briefly, since space frees up without a
+        // publish
+        uint64_t nap = 1000000ull;
+        now = chat_now_ns();
+        if (!blocked) {
+            nap = 100000000ull;
+            if (next < replay.count) {
+                uint64_t due = start + replay.messages[next].offset_ns;
+                nap = due <= now ? 0 : due - now < nap ? due - now : nap;
+            } else if (now - idle_since > (uint64_t)REPLAY_IDLE_MS * 1000000ull) {
+                break;  // Someone left early; what is missing is reported
+            }
+        } else if (now - idle_since > 1000000000ull) {
+            room_recover(shm, session.semid);
+        }
+        if (nap > 0) {
+            struct timespec timeout = {(time_t)(nap / 1000000000ull), (long)(nap % 1000000000ull)};
+            room_wait_published(shm, seen, &timeout);
+        }
+    }
+
+    out->end_ns = chat_now_ns();
+    chat_close(&session);
+    exit(0);
+}
+
+/* ---- Report ---- */
+
+static void print_latency(const char* label, const struct chat_histogram* hist) {
+    printf("%-12s p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", label,
+           hist_percentile(hist, 50.0) / 1000.0, hist_percentile(hist, 90.0) / 1000.0,
+           hist_percentile(hist, 99.0) / 1000.0, hist_percentile(hist, 99.9) / 1000.0,
+           (double)hist->max / 1000.0);
+}
+
+static void report(const struct replay_options* opt, struct replay_shared* shared, uint64_t start) {
+    struct chat_histogram* latency = malloc(sizeof(*latency));
+    struct chat_histogram* slip = malloc(sizeof(*slip));
+    uint64_t sent = 0, received = 0, bytes = 0, full = 0, end = start, expected = 0;
+    int joined = 0;
+
+    if (!latency || !slip) {
+        perror("malloc failed");
+        exit(1);
+    }
+    hist_init(latency);
+    hist_init(slip);
+    for (int u = 0; u < replay.user_count; u++) {
+        struct replay_result* r = &shared->results[u];
+        if (r->joined != 1) {
+            continue;
+        }
+        joined++;
+        sent += r->sent;
+        received += r->received;
+        bytes += r->bytes;
+        full += r->full_waits;
+        end = r->end_ns > end ? r->end_ns : end;
+        hist_merge(latency, &r->latency);
+        hist_merge(slip, &r->slip);
+    }
+    for (int u = 0; u < replay.user_count; u++) {
+        if (shared->results[u].joined == 1) {
+            expected += shared->results[u].sent * (uint64_t)(joined - 1);
+        }
+    }
+
+    double seconds = (double)(end - start) / 1e9;
+    double planned = replay.count ? (double)replay.messages[replay.count - 1].offset_ns / 1e9 : 0.0;
+    printf("%s=== Replay results ===%s\n", INFO_COLOR, COLOR_RESET);
+    printf("Members:     %d of %d joined ", joined, replay.user_count);
+    if (opt->channel[0] != '\0') {
+        printf("#%s", opt->channel);
+    } else {
+        printf("the main room");
+    }
+    if (replay.user_count > replay.sender_count) {
+        printf(", %d of them only listening", replay.user_count - replay.sender_count);
+    }
+    printf("\n");
+    printf("Sent:        %llu message(s), %.2f MB in %.2f s: %.0f msgs/s, %.2f MB/s",
+           (unsigned long long)sent, (double)bytes / 1e6, seconds, seconds > 0 ? (double)sent / seconds : 0.0,
+           seconds > 0 ? (double)bytes / 1e6 / seconds : 0.0);
+    if (!opt->max_rate && planned > 0) {
+        printf(" (schedule: %.0f msgs/s over %.2f s)", (double)replay.count / planned, planned);
+    }
+    printf("\n");
+    printf("Delivered:   %llu of %llu to the other members\n", (unsigned long long)received,
+           (unsigned long long)expected);
+    if (latency->total > 0) {
+        print_latency("Latency:", latency);
+    }
+    if (slip->total > 0) {
+        print_latency("Behind plan:", slip);
+    }
+    printf("Room full:   %llu time(s) a sender had to wait for space\n", (unsigned long long)full);
+    free(latency);
+    free(slip);
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [--speed N | --max-rate] [--max-gap S] [--users N] [--listeners N] [--channel NAME]\n"
+           "       [--archive] [LOG]\n",
+           prog);
+    printf("  LOG         the journal, or a chat history log, plain or gzipped (default %s if there\n"
+           "              is one, else %s)\n", JOURNAL_FILE, LOG_FILE);
+    printf("  --speed     play N times faster than the log's timestamps (default 1)\n");
+    printf("  --max-rate  ignore the timestamps: every member sends as fast as the room takes it\n");
+    printf("  --max-gap   cut pauses longer than S seconds down to S (before --speed)\n");
+    printf("  --users     simulated members at most; other senders are folded onto them (default %d)\n",
+           REPLAY_DEFAULT_USERS);
+    printf("  --listeners extra members that send nothing and only receive (default 0)\n");
+    printf("  --channel   channel to replay into, 'lobby' for the main room (default %s)\n",
+           REPLAY_DEFAULT_CHANNEL);
+    printf("  --archive   replay the text LOG's rotated generations, oldest first, before LOG itself\n");
+    printf("Segment options (used if the replay creates the room):\n");
+    room_config_usage();
+}
+
+int main(int argc, char* argv[]) {
+    struct replay_options opt = {
+        .speed = 1.0,
+        .max_users = REPLAY_DEFAULT_USERS,
+        .channel = REPLAY_DEFAULT_CHANNEL,
+    };
+    const char* path = NULL;
+
+    if (!room_config_parse(&argc, argv)) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            opt.speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-rate") == 0) {
+            opt.max_rate = 1;
+        } else if (strcmp(argv[i], "--max-gap") == 0 && i + 1 < argc) {
+            opt.max_gap = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--users") == 0 && i + 1 < argc) {
+            opt.max_users = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--listeners") == 0 && i + 1 < argc) {
+            opt.listeners = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--channel") == 0 && i + 1 < argc) {
+            opt.channel = argv[++i];
+            if (*opt.channel == '#') {
+                opt.channel++;
+            }
+            if (strcmp(opt.channel, "lobby") == 0) {
+                opt.channel = "";
+            }
+        } else if (strcmp(argv[i], "--archive") == 0) {
+            opt.archive = 1;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (opt.speed <= 0 || opt.max_gap < 0 || opt.max_users < 1 || opt.listeners < 0 ||
+        opt.max_users + opt.listeners > MAX_USERS || (opt.channel[0] != '\0' && !room_channel_valid(opt.channel))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!path) {
+        path = !opt.archive && access(JOURNAL_FILE, R_OK) == 0 ? JOURNAL_FILE : LOG_FILE;
+    }
+
+    replay.max_users = opt.max_users;
+    hist_init(&replay.sizes);
+    replay_load(path, opt.archive);
+    if (replay.count == 0) {
+        printf("%sNo messages found in %s (%zu other record(s)).%s\n", ERROR_COLOR, path, replay.skipped,
+               COLOR_RESET);
+        return 1;
+    }
+    replay_add_listeners(opt.listeners);
+    replay_schedule(&opt);
+
+    int64_t span = replay.messages[replay.count - 1].second - replay.messages[0].second;
+    printf("%s=== Replaying %s ===%s\n", INFO_COLOR, path, COLOR_RESET);
+    printf("Log:         %zu message(s) from %d member(s) over %lld s; %zu other record(s) skipped",
+           replay.count, replay.sender_count, (long long)span, replay.skipped);
+    if (replay.duplicates > 0) {
+        printf(", %zu repeated cop%s dropped", replay.duplicates, replay.duplicates == 1 ? "y" : "ies");
+    }
+    printf("\n");
+    printf("Sizes:       p50 %llu B, p99 %llu B, max %llu B, %.2f MB in all\n",
+           (unsigned long long)hist_percentile(&replay.sizes, 50.0),
+           (unsigned long long)hist_percentile(&replay.sizes, 99.0), (unsigned long long)replay.sizes.max,
+           (double)(replay.text_len - replay.count) / 1e6);
+    if (opt.max_rate) {
+        printf("Pacing:      as fast as the room takes it\n");
+    } else {
+        printf("Pacing:      %gx the log's pace%s\n", opt.speed, opt.max_gap > 0 ? ", long pauses cut" : "");
+    }
+    if (replay.sender_count == 1 && opt.listeners == 0) {
+        printf("%sOne member spoke, so nobody receives; add --listeners N to measure fan-out.%s\n",
+               INFO_COLOR, COLOR_RESET);
+    }
+    fflush(stdout);
+
+    size_t shared_size = sizeof(struct replay_shared) + (size_t)replay.user_count * sizeof(struct replay_result);
+    struct replay_shared* shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                                        -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+
+    // Everyone joins before anyone sends, so nobody misses a message
+    for (int u = 0; u < replay.user_count; u++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            replay_member(u, &opt, shared);
+        }
+        if (pid == -1) {
+            perror("fork failed");
+            shared->results[u].joined = -1;
+            atomic_fetch_add(&shared->ready, 1);
+        }
+    }
+    struct timespec step = {0, 1000000L};
+    while (atomic_load(&shared->ready) < replay.user_count) {
+        nanosleep(&step, NULL);
+    }
+    uint64_t start = chat_now_ns() + 10000000ull;
+    atomic_store(&shared->start_ns, start);
+    while (wait(NULL) > 0) {
+    }
+
+    report(&opt, shared, start);
+    munmap(shared, shared_size);
+    return 0;
+}